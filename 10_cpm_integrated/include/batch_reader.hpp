@@ -0,0 +1,83 @@
+#ifndef __BATCH_READER_HPP__
+#define __BATCH_READER_HPP__
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "opencv2/opencv.hpp"
+#include "job_queue.hpp"
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+namespace batchio{
+
+/*
+ * 一次读一整个batch的文件, 读进内存之后再交给cv::imdecode
+ *  有liburing(编译时定义HAVE_LIBURING)并且内核支持io_uring的IORING_OP_READ(5.6以后)的时候:
+ *    一个batch的read一次性全部提交, 存储设备上同时有queueDepth个请求在排队, 而不是一个文件一个文件地等
+ *  否则退回到线程池: numThreads个线程各自open + pread + close
+ *  运行中io_uring出错(提交失败, 完成里返回-EINVAL)时也会换成线程池, 没读完的文件由线程池重新读
+ *
+ *  open和fstat还是同步的(通常都在dentry/inode cache里), 真正慢的是冷缓存时读数据
+ */
+class BatchReader{
+public:
+    explicit BatchReader(int numThreads = 4, unsigned queueDepth = 64);
+    ~BatchReader();
+
+    BatchReader(const BatchReader&)            = delete;
+    BatchReader& operator=(const BatchReader&) = delete;
+
+    /* buffers[i]是paths[i]的全部内容, 读失败的文件buffers[i]为空, 返回读成功的个数 */
+    int read(const std::vector<std::string>& paths, std::vector<std::vector<uchar>>& buffers);
+
+    /* 实际使用的方式: "io_uring"或者"threadpool" */
+    const char* backend() const;
+
+private:
+    struct Task{
+        const std::string*  path{nullptr};
+        std::vector<uchar>* buffer{nullptr};
+    };
+
+    void startPool();
+    void readPool(const std::vector<std::string>& paths, std::vector<std::vector<uchar>>& buffers);
+    void worker();
+
+    static bool readFile(const std::string& path, std::vector<uchar>& buffer);
+
+#ifdef HAVE_LIBURING
+    /* 内核支不支持IORING_OP_READ */
+    bool readSupported();
+
+    /*
+     * io_uring读一个batch, io_uring不能再用的时候返回false(提交失败, 或者内核不支持read)
+     *  这时没有读完的文件的下标放进retry, 由调用的一方交给线程池重新读
+     */
+    bool readUring(const std::vector<std::string>& paths, std::vector<std::vector<uchar>>& buffers,
+                   std::vector<size_t>& retry);
+
+    io_uring m_ring;
+    unsigned m_queueDepth;
+    bool     m_uring{false};
+
+    /* 出错时内核可能还在写的buffer, 不能释放, 留到析构 */
+    std::vector<std::vector<uchar>> m_orphans;
+#endif
+
+    int                                       m_numThreads;
+    std::unique_ptr<jobqueue::JobQueue<Task>> m_tasks;
+    std::vector<std::thread>                  m_threads;
+
+    /* 线程池读一个batch时的完成计数 */
+    std::mutex              m_mtx;
+    std::condition_variable m_done;
+    int                     m_remaining{0};
+};
+
+} // namespace batchio
+
+#endif //__BATCH_READER_HPP__
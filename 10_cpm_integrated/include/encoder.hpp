@@ -0,0 +1,50 @@
+#ifndef __ENCODER_HPP__
+#define __ENCODER_HPP__
+
+#include <cstdint>
+#include <vector>
+#include "opencv2/opencv.hpp"
+
+namespace encoder{
+
+/*
+ * 结果图片的编码方式, 用磁盘换CPU:
+ *  PNG:  无损, 最省磁盘, 也最慢; pngLevel越大越慢, 0是不压缩的PNG
+ *  JPEG: 有损, 快, 文件小
+ *  Raw:  不编码, 16字节的头 + 原始的像素, 写盘的字节最多, CPU基本为0
+ *  QOI:  无损, 比PNG快很多, 文件比PNG大一些(https://qoiformat.org)
+ */
+enum class Format : int {
+    PNG  = 0,
+    JPEG = 1,
+    Raw  = 2,
+    QOI  = 3,
+};
+
+struct Options{
+    Format format      = Format::PNG;
+    int    pngLevel    = -1;    // 0 ~ 9, -1是OpenCV默认的压缩等级
+    int    jpegQuality = 95;    // 0 ~ 100
+};
+
+/* Raw的文件头, 后面紧跟着rows * cols * elemSize字节的像素, 所有的整数都是小端 */
+struct RawHeader{
+    char    magic[8];   // "CPMRAW\0\0"
+    int32_t rows;
+    int32_t cols;
+};
+
+const char* name(Format format);
+
+/* 文件的后缀, 带"." */
+const char* extension(Format format);
+
+/*
+ * 把img编码到out里, 失败的时候返回false
+ *  Raw和QOI只支持8位的3通道(BGR)图片, QOI里存的是RGB
+ */
+bool encode(const cv::Mat& img, const Options& options, std::vector<uchar>& out);
+
+} // namespace encoder
+
+#endif //__ENCODER_HPP__
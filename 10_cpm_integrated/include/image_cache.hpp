@@ -0,0 +1,66 @@
+#ifndef __IMAGE_CACHE_HPP__
+#define __IMAGE_CACHE_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "opencv2/opencv.hpp"
+
+namespace imgcache{
+
+/*
+ * 解码之后的图片的LRU缓存, key是图片路径
+ *  同一张图片再次出现的时候直接返回缓存里的cv::Mat, 不需要再读文件和解码
+ *  按字节数限制大小: 放不下的时候从最久没有用过的开始淘汰, 比整个容量还大的图片不缓存
+ *  capacityBytes为0时不缓存, get永远返回false
+ *  线程安全, 多个解码线程可以同时get/put
+ *
+ *  get返回的Mat和缓存共享同一块内存(只增加引用计数), 不要修改它的内容
+ *  被淘汰的Mat只是缓存不再引用, 外面还在用的话内存不会被释放
+ */
+class ImageCache{
+public:
+    explicit ImageCache(size_t capacityBytes);
+
+    ImageCache(const ImageCache&)            = delete;
+    ImageCache& operator=(const ImageCache&) = delete;
+
+    bool get(const std::string& path, cv::Mat& img);
+    void put(const std::string& path, const cv::Mat& img);
+
+    bool   enabled() const  { return m_capacity > 0; }
+    size_t capacity() const { return m_capacity; }
+    size_t bytes() const;
+
+    long hits() const      { return m_hits.load(); }
+    long misses() const    { return m_misses.load(); }
+    long evictions() const { return m_evictions.load(); }
+
+    /* 打印命中率, 淘汰次数和当前占用 */
+    void report() const;
+
+private:
+    struct Entry{
+        std::string path;
+        cv::Mat     img;
+        size_t      bytes;
+    };
+    using List = std::list<Entry>;
+
+    size_t                                          m_capacity;
+    mutable std::mutex                              m_mtx;
+    List                                            m_lru;       // 最近用过的在前面
+    std::unordered_map<std::string, List::iterator> m_index;
+    size_t                                          m_bytes{0};
+
+    std::atomic<long>                               m_hits{0};
+    std::atomic<long>                               m_misses{0};
+    std::atomic<long>                               m_evictions{0};
+};
+
+} // namespace imgcache
+
+#endif //__IMAGE_CACHE_HPP__
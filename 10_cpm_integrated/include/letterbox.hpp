@@ -0,0 +1,191 @@
+#ifndef __LETTERBOX_HPP__
+#define __LETTERBOX_HPP__
+
+#include <algorithm>
+#include <vector>
+#include "opencv2/opencv.hpp"
+
+namespace preprocess{
+
+// letterbox之后图片在target里的位置
+struct Geometry{
+    int new_w;
+    int new_h;
+    int x;
+    int y;
+};
+
+Geometry letterbox_geometry(int input_w, int input_h, int target_w, int target_h);
+
+/*
+ * 原来consumer里的实现, 作为对照:
+ *  zero fill -> cv::resize到tmp -> copy到ROI -> BGR2RGB -> RGB2BGR
+ */
+void letterbox_opencv(const cv::Mat& src, cv::Mat& dst, int target_w, int target_h);
+
+/*
+ * 融合后的实现:
+ *  一行一行地生成dst, 每一行只写一次: 上下的pad直接填0, 中间的行是 左pad + resize的结果 + 右pad
+ *  resize和OpenCV的INTER_LINEAR用同样的定点算法(11bit的系数), 结果和letterbox_opencv逐字节一致
+ *  宽高都正好缩小一半时和cv::resize一样换成INTER_AREA(2x2取平均)
+ *  swapRB为true时在写出这一行的同时交换R和B通道
+ *  dst已经是target大小的CV_8UC3时直接写进去, 不会重新分配
+ */
+void letterbox(const cv::Mat& src, cv::Mat& dst, int target_w, int target_h, bool swapRB = false);
+
+/*
+ * 和letterbox一样, 但是直接写成planar的float: dst指向[3, target_h, target_w]的连续内存
+ * 值的范围还是0~255, 一般dst是batch tensor [N, 3, H, W]里的某一个切片
+ */
+void letterbox_nchw(const cv::Mat& src, float* dst, int target_w, int target_h, bool swapRB = false);
+
+/*
+ * 对同一张图分别跑letterbox_opencv和letterbox, 返回不一致的字节数
+ * 用来确认融合实现和OpenCV的结果bit-exact
+ */
+long letterbox_check(const cv::Mat& src, int target_w, int target_h);
+
+// 运行时选择的SIMD实现: "avx2", "sse2"或者"scalar"
+const char* simd_name();
+
+/* ------------------------------------ 按行生成 ------------------------------------ */
+/*
+ * letterbox和preprocess.hpp里的流水线共用的行驱动, 放在头文件里:
+ *  写到哪里由模板参数Writer决定, 每一行的回调可以内联
+ *  水平方向的resize和两行的缓存也在这里, 只有垂直方向的SIMD实现(vresize_kernel)在letterbox.cpp里
+ */
+
+// 系数是11bit的定点数(1.0 == 2048), 和OpenCV里8U的INTER_LINEAR一样
+constexpr int kCoefBits  = 11;
+constexpr int kCoefScale = 1 << kCoefBits;
+
+// 垂直方向: 把两行水平resize之后的结果按系数b0, b1合成一行
+typedef void (*VResizeFunc)(const int* S0, const int* S1, uchar* dst, int width, int b0, int b1);
+
+// 运行时选择的当前CPU上最快的实现, 和simd_name对应
+VResizeFunc vresize_kernel();
+
+struct ResizeTables{
+    int                src_w{0}, src_h{0}, dst_w{0}, dst_h{0};
+    int                xmax;    // 从第xmax个dst像素开始, 右边的源像素越界了, 直接用最右边的源像素
+    std::vector<int>   xofs;    // 每个dst像素对应的左边源像素的下标(已经乘了通道数)
+    std::vector<short> alpha;   // 每个dst像素的两个水平系数
+    std::vector<int>   yofs;    // 每个dst行对应的上面的源行, 可能是-1或者src_h - 1
+    std::vector<short> beta;    // 每个dst行的两个垂直系数
+};
+
+// 和上一次的大小一样的时候直接返回, 不重新计算
+void build_resize_tables(ResizeTables& t, int src_w, int src_h, int dst_w, int dst_h);
+
+// 每个线程自己的缓存, 同样大小的图片不会重复计算系数, 也不会每帧都分配内存
+struct ResizeScratch{
+    ResizeTables       tables;
+    std::vector<int>   rows[2];
+    int                rowIndex[2];
+    std::vector<uchar> out;     // 给不直接写dst的Writer用的一行
+};
+
+inline ResizeScratch& resize_scratch(){
+    thread_local ResizeScratch s;
+    return s;
+}
+
+inline void hresize(const uchar* S, int* D, const ResizeTables& t){
+    int dx = 0;
+    for (; dx < t.xmax; dx ++){
+        const uchar* s  = S + t.xofs[dx];
+        int          a0 = t.alpha[dx * 2];
+        int          a1 = t.alpha[dx * 2 + 1];
+        D[dx * 3]     = s[0] * a0 + s[3] * a1;
+        D[dx * 3 + 1] = s[1] * a0 + s[4] * a1;
+        D[dx * 3 + 2] = s[2] * a0 + s[5] * a1;
+    }
+    for (; dx < t.dst_w; dx ++){
+        const uchar* s = S + t.xofs[dx];
+        D[dx * 3]     = s[0] * kCoefScale;
+        D[dx * 3 + 1] = s[1] * kCoefScale;
+        D[dx * 3 + 2] = s[2] * kCoefScale;
+    }
+}
+
+// 取源图第row行水平resize之后的结果, 两行缓存里保留keep这一行
+inline const int* fetch_row(ResizeScratch& s, const cv::Mat& src, int row, int keep){
+    for (int i = 0; i < 2; i ++){
+        if (s.rowIndex[i] == row) return s.rows[i].data();
+    }
+    int slot = (s.rowIndex[0] != keep) ? 0 : 1;
+    hresize(src.ptr<uchar>(row), s.rows[slot].data(), s.tables);
+    s.rowIndex[slot] = row;
+    return s.rows[slot].data();
+}
+
+/*
+ * 宽高都正好缩小一半的时候, cv::resize会把INTER_LINEAR换成INTER_AREA的快速实现:
+ *  每个dst像素是源图2x2个像素的平均, (a + b + c + d + 2) >> 2
+ *  和双线性的系数(各1/4)算出来的值不一样, 这里按照OpenCV的做法单独处理
+ */
+inline void area2x_row(const uchar* S0, const uchar* S1, uchar* dst, int width){
+    for (int x = 0; x < width; x ++, S0 += 6, S1 += 6, dst += 3){
+        dst[0] = (uchar)((S0[0] + S0[3] + S1[0] + S1[3] + 2) >> 2);
+        dst[1] = (uchar)((S0[1] + S0[4] + S1[1] + S1[4] + 2) >> 2);
+        dst[2] = (uchar)((S0[2] + S0[5] + S1[2] + S1[5] + 2) >> 2);
+    }
+}
+
+/*
+ * 按行生成letterbox的结果, 具体写到哪里由Writer决定:
+ *  writer.pad(dy):          第dy行整行都是pad
+ *  writer.span(dy):         第dy行中间resize结果(new_w * 3个字节)要写到的位置
+ *  writer.commit(dy, span): resize结果已经写好了, 写出这一行剩下的部分
+ */
+template <typename Writer>
+void letterbox_rows(const cv::Mat& src, const Geometry& g, int target_h, VResizeFunc vresize, Writer& writer){
+    CV_Assert(src.type() == CV_8UC3);
+
+    /* 正好2倍缩小的时候和cv::resize一样走INTER_AREA */
+    if (src.cols == g.new_w * 2 && src.rows == g.new_h * 2){
+        for (int dy = 0; dy < target_h; dy ++){
+            int ry = dy - g.y;
+            if (ry < 0 || ry >= g.new_h){
+                writer.pad(dy);
+                continue;
+            }
+            uchar* span = writer.span(dy);
+            area2x_row(src.ptr<uchar>(ry * 2), src.ptr<uchar>(ry * 2 + 1), span, g.new_w);
+            writer.commit(dy, span);
+        }
+        return;
+    }
+
+    ResizeScratch& s = resize_scratch();
+    build_resize_tables(s.tables, src.cols, src.rows, g.new_w, g.new_h);
+    int width = g.new_w * 3;
+    for (int i = 0; i < 2; i ++){
+        if ((int)s.rows[i].size() < width) s.rows[i].resize(width);
+        s.rowIndex[i] = -1;
+    }
+
+    for (int dy = 0; dy < target_h; dy ++){
+        int ry = dy - g.y;
+
+        /* 上下的pad */
+        if (ry < 0 || ry >= g.new_h){
+            writer.pad(dy);
+            continue;
+        }
+
+        int sy = s.tables.yofs[ry];
+        int r0 = (std::max)(0, (std::min)(src.rows - 1, sy));
+        int r1 = (std::max)(0, (std::min)(src.rows - 1, sy + 1));
+        const int* H0 = fetch_row(s, src, r0, r1);
+        const int* H1 = fetch_row(s, src, r1, r0);
+
+        uchar* span = writer.span(dy);
+        vresize(H0, H1, span, width, s.tables.beta[ry * 2], s.tables.beta[ry * 2 + 1]);
+        writer.commit(dy, span);
+    }
+}
+
+} // namespace preprocess
+
+#endif //__LETTERBOX_HPP__
@@ -7,6 +7,8 @@
 #include <vector>
 #include <string>
 #include "opencv2/opencv.hpp"
+#include "job_queue.hpp"
+#include "encoder.hpp"
 
 namespace model{
 
@@ -22,7 +24,15 @@ public:
     virtual void stop() = 0;
 };
 
-std::shared_ptr<Model> create_model (std::string* img_list, int batchSize);
+/*
+ * numWriters: 负责把结果编码写盘的线程个数, 和消费者是分开的
+ * cacheBytes: 解码之后的图片的LRU缓存大小(字节), 重复出现的图片不再读文件和解码, 0表示不缓存
+ * encode:     结果的编码方式(PNG/JPEG/Raw/QOI), 结果文件的后缀跟着变
+ */
+std::shared_ptr<Model> create_model (std::string* img_list, int batchSize,
+                                     jobqueue::QueueType queueType = jobqueue::QueueType::Ring,
+                                     int numWriters = 2, size_t cacheBytes = 0,
+                                     const encoder::Options& encode = encoder::Options());
     
 }// namespace model
 #endif __MODEL_HPP__
@@ -0,0 +1,241 @@
+#ifndef __PREPROCESS_HPP__
+#define __PREPROCESS_HPP__
+
+#include <cmath>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+#include "opencv2/opencv.hpp"
+#include "letterbox.hpp"
+
+namespace preprocess{
+
+/*
+ * 编译期组合的预处理流水线:
+ *  Pipeline<Resize, Pad, Color, Norm, Layout>::run(src, dst, target_w, target_h)
+ *
+ *  Resize: Linear(和cv::resize的INTER_LINEAR逐字节一致, 包括正好2倍缩小时换成INTER_AREA的情况, SIMD) / Nearest
+ *  Pad:    Pad<114>, letterbox两边填充的像素值(归一化之前)
+ *  Color:  BGR(保持不变) / RGB(交换R和B)
+ *  Norm:   Identity(0~255) / Unit(0~1) / ImageNet(减均值除方差)
+ *  Layout: HWC<uchar> / HWC<float> / CHW<float>
+ *
+ *  每一个策略都是一个只有静态inline函数的类型, 整条流水线在编译期展开:
+ *  resize出来的一行直接在同一个循环里完成 通道顺序 + 归一化 + 写到对应layout的位置, 不需要中间的Mat
+ *  dst的每一个元素只写一次
+ */
+
+/* ------------------------------------ resize ------------------------------------ */
+
+// resize之后的一行, 第x个像素是连续的3个字节
+struct PackedRow{
+    const uchar* data;
+    const uchar* operator()(int x) const { return data + x * 3; }
+};
+
+// 最近邻直接指向源图的一行, 第x个像素的位置查表
+struct IndexedRow{
+    const uchar* data;
+    const int*   ofs;
+    const uchar* operator()(int x) const { return data + ofs[x]; }
+};
+
+// 和letterbox用同一个行驱动(letterbox_rows), sink在每一行的循环里内联展开
+struct Linear{
+    template <typename Sink>
+    static void rows(const cv::Mat& src, const Geometry& g, int target_h, Sink& sink){
+        std::vector<uchar>& out = resize_scratch().out;
+        if ((int)out.size() < g.new_w * 3) out.resize(g.new_w * 3);
+
+        RowWriter<Sink> writer{sink, out.data()};
+        letterbox_rows(src, g, target_h, vresize_kernel(), writer);
+    }
+
+private:
+    // resize的结果先放在一行的缓存里再交给sink, 上下左右的pad由sink的一方自己处理
+    template <typename Sink>
+    struct RowWriter{
+        Sink&  sink;
+        uchar* row;
+
+        void   pad(int dy) {}
+        uchar* span(int dy) { return row; }
+        void   commit(int dy, uchar* span) { sink(dy, PackedRow{span}); }
+    };
+};
+
+// 和INTER_NEAREST一样取floor(dx * scale), 不需要行缓存, 直接从源图里取像素
+struct Nearest{
+    template <typename Sink>
+    static void rows(const cv::Mat& src, const Geometry& g, int target_h, Sink& sink){
+        thread_local std::vector<int> xofs;
+        xofs.resize(g.new_w);
+
+        double sx = double(src.cols) / g.new_w;
+        double sy = double(src.rows) / g.new_h;
+        for (int x = 0; x < g.new_w; x ++)
+            xofs[x] = (std::min)(int(std::floor(x * sx)), src.cols - 1) * 3;
+
+        for (int y = 0; y < g.new_h; y ++){
+            int r = (std::min)(int(std::floor(y * sy)), src.rows - 1);
+            sink(g.y + y, IndexedRow{src.ptr<uchar>(r), xofs.data()});
+        }
+    }
+};
+
+/* ------------------------------------- pad -------------------------------------- */
+
+template <int V>
+struct Pad{
+    static_assert(V >= 0 && V <= 255, "pad value must be a uint8 pixel");
+    static constexpr int value = V;
+};
+
+/* ------------------------------------ color ------------------------------------- */
+
+// 输出的第c个通道取源图(BGR)的第channel(c)个通道
+struct BGR{
+    static constexpr int channel(int c) { return c; }
+};
+
+struct RGB{
+    static constexpr int channel(int c) { return 2 - c; }
+};
+
+/* ---------------------------------- normalize ----------------------------------- */
+
+struct Identity{
+    static constexpr bool identity = true;
+
+    template <typename T>
+    static T apply(int c, uchar v) { return T(v); }
+};
+
+// v / 255
+struct Unit{
+    static constexpr bool identity = false;
+
+    template <typename T>
+    static T apply(int c, uchar v) { return T(v * (1.f / 255.f)); }
+};
+
+// (v / 255 - mean) / std, 按输出的通道顺序(RGB)
+struct ImageNet{
+    static constexpr bool identity = false;
+
+    static constexpr float mean(int c) { return c == 0 ? 0.485f : (c == 1 ? 0.456f : 0.406f); }
+    static constexpr float stdv(int c) { return c == 0 ? 0.229f : (c == 1 ? 0.224f : 0.225f); }
+
+    template <typename T>
+    static T apply(int c, uchar v) { return T(v * (1.f / (255.f * stdv(c))) - mean(c) / stdv(c)); }
+};
+
+/* ------------------------------------ layout ------------------------------------ */
+
+// 交错存放, 一个像素的3个通道相邻
+template <typename T>
+struct HWC{
+    using value_type = T;
+    static constexpr int step = 3;
+
+    static T* row(T* dst, int c, int dy, int target_w, int target_h){
+        return dst + size_t(dy) * target_w * 3 + c;
+    }
+};
+
+// 平面存放, 每个通道一个target_w * target_h的平面
+template <typename T>
+struct CHW{
+    using value_type = T;
+    static constexpr int step = 1;
+
+    static T* row(T* dst, int c, int dy, int target_w, int target_h){
+        return dst + size_t(c) * target_w * target_h + size_t(dy) * target_w;
+    }
+};
+
+/* ----------------------------------- pipeline ----------------------------------- */
+
+template <typename Resize, typename PadT, typename Color, typename Norm, typename Layout>
+struct Pipeline{
+    using value_type = typename Layout::value_type;
+
+    static_assert(Norm::identity || std::is_floating_point<value_type>::value,
+                  "normalized output needs a floating point layout");
+
+    /* dst指向target_w * target_h * 3个value_type的连续内存 */
+    static void run(const cv::Mat& src, value_type* dst, int target_w, int target_h){
+        CV_Assert(src.type() == CV_8UC3);
+
+        Writer w;
+        w.dst      = dst;
+        w.target_w = target_w;
+        w.target_h = target_h;
+        w.g        = letterbox_geometry(src.cols, src.rows, target_w, target_h);
+        for (int c = 0; c < 3; c ++)
+            w.pad[c] = Norm::template apply<value_type>(c, uchar(PadT::value));
+
+        /* 上下的pad, 中间的行由resize一行一行地交给writer */
+        for (int dy = 0; dy < w.g.y; dy ++)
+            w.fill(dy, 0, target_w);
+        for (int dy = w.g.y + w.g.new_h; dy < target_h; dy ++)
+            w.fill(dy, 0, target_w);
+
+        Resize::rows(src, w.g, target_h, w);
+    }
+
+    /* HWC的时候直接输出cv::Mat, dst已经是target大小的时候不会重新分配 */
+    static void run(const cv::Mat& src, cv::Mat& dst, int target_w, int target_h){
+        static_assert(Layout::step == 3, "cv::Mat output needs an HWC layout");
+        dst.create(target_h, target_w, CV_MAKETYPE(cv::DataType<value_type>::depth, 3));
+        CV_Assert(dst.isContinuous());
+        run(src, dst.ptr<value_type>(), target_w, target_h);
+    }
+
+private:
+    struct Writer{
+        value_type* dst;
+        int         target_w;
+        int         target_h;
+        Geometry    g;
+        value_type  pad[3];
+
+        void fill(int dy, int begin, int end){
+            for (int c = 0; c < 3; c ++){
+                value_type* out = Layout::row(dst, c, dy, target_w, target_h);
+                for (int x = begin; x < end; x ++) out[x * Layout::step] = pad[c];
+            }
+        }
+
+        template <typename Row>
+        void operator()(int dy, const Row& row){
+            fill(dy, 0, g.x);
+            fill(dy, g.x + g.new_w, target_w);
+
+            value_type* out0 = Layout::row(dst, 0, dy, target_w, target_h) + g.x * Layout::step;
+            value_type* out1 = Layout::row(dst, 1, dy, target_w, target_h) + g.x * Layout::step;
+            value_type* out2 = Layout::row(dst, 2, dy, target_w, target_h) + g.x * Layout::step;
+            for (int x = 0; x < g.new_w; x ++){
+                const uchar* px = row(x);
+                out0[x * Layout::step] = Norm::template apply<value_type>(0, px[Color::channel(0)]);
+                out1[x * Layout::step] = Norm::template apply<value_type>(1, px[Color::channel(1)]);
+                out2[x * Layout::step] = Norm::template apply<value_type>(2, px[Color::channel(2)]);
+            }
+        }
+    };
+};
+
+/* ------------------------------- 常用的组合 ------------------------------------- */
+
+// 原来consumer里的 letterbox -> BGR2RGB -> RGB2BGR, 结果是0填充的BGR uint8
+using LetterboxBGR  = Pipeline<Linear, Pad<0>, BGR, Identity, HWC<uchar>>;
+
+// 网络的输入: RGB平面, 0~255的float
+using LetterboxNCHW = Pipeline<Linear, Pad<0>, RGB, Identity, CHW<float>>;
+
+// yolo风格: 114灰色填充, RGB平面, 0~1
+using YoloNCHW      = Pipeline<Linear, Pad<114>, RGB, Unit, CHW<float>>;
+
+} // namespace preprocess
+
+#endif //__PREPROCESS_HPP__
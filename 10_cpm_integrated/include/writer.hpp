@@ -0,0 +1,74 @@
+#ifndef __WRITER_HPP__
+#define __WRITER_HPP__
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "opencv2/opencv.hpp"
+#include "job_queue.hpp"
+#include "encoder.hpp"
+
+namespace writer{
+
+/*
+ * 异步的结果写入:
+ *  消费者只需要把(路径, 图片)交给write, 编码和写盘由writer自己的线程去做
+ *  编码方式由encoder::Options决定(PNG/JPEG/Raw/QOI), 路径的后缀由调用的人按encoder::extension给
+ *  队列有上限, 满了之后write会阻塞(backpressure), 写盘跟不上的时候不会无限占用内存
+ *  flush: 等待所有已经交给write的图片都写完
+ *  stop:  flush之后结束所有writer线程, 之后的write返回false
+ */
+class AsyncWriter{
+public:
+    AsyncWriter(int numThreads, size_t capacity, const encoder::Options& options = encoder::Options());
+    ~AsyncWriter();
+
+    AsyncWriter(const AsyncWriter&)            = delete;
+    AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+    /* img只是增加引用计数, 调用之后不要再修改img的内容 */
+    bool write(const std::string& path, const cv::Mat& img);
+    void flush();
+    void stop();
+
+    const encoder::Options& options() const { return m_options; }
+
+    /* 
+     * 打印写了多少张, 编码的吞吐(每个writer线程每秒编码多少张, 多少MB的像素), 写出去的大小和压缩比,
+     * 写盘的总时间, 以及消费者被backpressure卡住的总时间
+     */
+    void report() const;
+
+private:
+    struct Task{
+        std::string path;
+        cv::Mat     img;
+    };
+
+    void run(int index);
+
+    encoder::Options         m_options;
+    std::unique_ptr<jobqueue::JobQueue<Task>> m_queue;
+    std::vector<std::thread> m_threads;
+
+    std::mutex              m_mtx;
+    std::condition_variable m_idle;
+    long                    m_pending{0};      // 已经交给write, 还没有写完的张数
+    bool                    m_stopped{false};
+
+    std::atomic<long>       m_written{0};
+    std::atomic<long>       m_failed{0};
+    std::atomic<long>       m_encodeUs{0};     // writer线程编码的总时间
+    std::atomic<long>       m_writeUs{0};      // writer线程写盘的总时间
+    std::atomic<long>       m_rawBytes{0};     // 编码之前的像素字节数
+    std::atomic<long>       m_fileBytes{0};    // 写出去的文件字节数
+    std::atomic<long>       m_blockedUs{0};    // write因为队列满而阻塞的总时间
+};
+
+} // namespace writer
+
+#endif //__WRITER_HPP__
@@ -0,0 +1,272 @@
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "batch_reader.hpp"
+#include "logger.hpp"
+
+using namespace std;
+
+namespace batchio{
+
+BatchReader::BatchReader(int numThreads, unsigned queueDepth) :
+#ifdef HAVE_LIBURING
+    m_queueDepth(queueDepth > 0 ? queueDepth : 1),
+#endif
+    m_numThreads(numThreads > 0 ? numThreads : 1)
+{
+#ifdef HAVE_LIBURING
+    /* 内核太老或者被seccomp禁掉(比如某些容器)的时候会失败, 这时候用线程池 */
+    int ret = io_uring_queue_init(m_queueDepth, &m_ring, 0);
+    m_uring = ret == 0;
+    if (!m_uring)
+        LOGW("[reader] io_uring unavailable (%s), falling back to thread pool", strerror(-ret));
+
+    /* 5.6之前的内核能建ring, 但是不支持IORING_OP_READ, 要到提交之后才会在完成里返回-EINVAL, 所以先查一下 */
+    if (m_uring && !readSupported()){
+        LOGW("[reader] io_uring has no IORING_OP_READ on this kernel, falling back to thread pool");
+        io_uring_queue_exit(&m_ring);
+        m_uring = false;
+    }
+    if (m_uring) return;
+#endif
+    startPool();
+}
+
+BatchReader::~BatchReader(){
+    if (m_tasks) m_tasks->close();
+    for (auto& t: m_threads){
+        if (t.joinable()) t.join();
+    }
+#ifdef HAVE_LIBURING
+    if (m_uring) io_uring_queue_exit(&m_ring);
+#endif
+}
+
+const char* BatchReader::backend() const{
+#ifdef HAVE_LIBURING
+    if (m_uring) return "io_uring";
+#endif
+    return "threadpool";
+}
+
+int BatchReader::read(const vector<string>& paths, vector<vector<uchar>>& buffers){
+    buffers.resize(paths.size());
+#ifdef HAVE_LIBURING
+    if (m_uring){
+        /* io_uring用不了的时候以后都换成线程池, 这个batch里没读完的文件也交给线程池重新读 */
+        vector<size_t> retry;
+        if (!readUring(paths, buffers, retry)){
+            LOGW("[reader] io_uring failed, falling back to thread pool");
+            io_uring_queue_exit(&m_ring);
+            m_uring = false;
+            startPool();
+        }
+        if (!retry.empty()){
+            vector<string>         subPaths;
+            vector<vector<uchar>>  subBuffers(retry.size());
+            for (size_t i: retry) subPaths.push_back(paths[i]);
+            readPool(subPaths, subBuffers);
+            for (size_t k = 0; k < retry.size(); k ++) buffers[retry[k]].swap(subBuffers[k]);
+        }
+    } else
+#endif
+        readPool(paths, buffers);
+
+    int ok = 0;
+    for (auto& b: buffers) ok += !b.empty();
+    return ok;
+}
+
+/* ------------------------------------ 线程池 ------------------------------------ */
+
+void BatchReader::startPool(){
+    if (m_tasks) return;
+    m_tasks.reset(new jobqueue::MutexQueue<Task>());
+    for (int i = 0; i < m_numThreads; i ++){
+        m_threads.emplace_back(&BatchReader::worker, this);
+    }
+}
+
+bool BatchReader::readFile(const string& path, vector<uchar>& buffer){
+    buffer.clear();
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && st.st_size > 0;
+    if (ok){
+        buffer.resize(st.st_size);
+        size_t done = 0;
+        while (done < buffer.size()){
+            ssize_t n = pread(fd, buffer.data() + done, buffer.size() - done, done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            done += n;
+        }
+        ok = done == buffer.size();
+    }
+    close(fd);
+
+    if (!ok) buffer.clear();
+    return ok;
+}
+
+void BatchReader::worker(){
+    Task task;
+    while (m_tasks->pop(task)){
+        readFile(*task.path, *task.buffer);
+        {
+            lock_guard<mutex> lock(m_mtx);
+            m_remaining --;
+        }
+        m_done.notify_all();
+    }
+}
+
+void BatchReader::readPool(const vector<string>& paths, vector<vector<uchar>>& buffers){
+    vector<Task> tasks(paths.size());
+    for (size_t i = 0; i < paths.size(); i ++){
+        tasks[i].path   = &paths[i];
+        tasks[i].buffer = &buffers[i];
+    }
+
+    {
+        lock_guard<mutex> lock(m_mtx);
+        m_remaining = (int)tasks.size();
+    }
+    m_tasks->push_bulk(tasks);
+
+    unique_lock<mutex> lock(m_mtx);
+    m_done.wait(lock, [&](){ return m_remaining == 0; });
+}
+
+/* ------------------------------------ io_uring ------------------------------------ */
+
+#ifdef HAVE_LIBURING
+bool BatchReader::readSupported(){
+    io_uring_probe* probe = io_uring_get_probe_ring(&m_ring);
+    bool ok = probe && io_uring_opcode_supported(probe, IORING_OP_READ);
+    if (probe) io_uring_free_probe(probe);
+    return ok;
+}
+
+bool BatchReader::readUring(const vector<string>& paths, vector<vector<uchar>>& buffers, vector<size_t>& retry){
+    struct File{
+        int    fd{-1};
+        size_t done{0};
+        bool   busy{false};   // 有一个read提交了还没有完成, 内核可能还在往buffer里写
+    };
+    vector<File> files(paths.size());
+    deque<size_t> ready;   // 还需要提交read的文件(第一次, 或者上一次只读了一部分)
+
+    for (size_t i = 0; i < paths.size(); i ++){
+        buffers[i].clear();
+        int fd = open(paths[i].c_str(), O_RDONLY);
+        if (fd < 0) continue;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size <= 0){
+            close(fd);
+            continue;
+        }
+        buffers[i].resize(st.st_size);
+        files[i].fd = fd;
+        ready.push_back(i);
+    }
+
+    /* 出错的文件: 关掉fd, 内容清空 */
+    auto fail = [&](size_t i){
+        close(files[i].fd);
+        files[i].fd = -1;
+        buffers[i].clear();
+    };
+
+    bool     usable  = true;
+    unsigned pending = 0;   // 放进了SQ, 还没有收到完成的read
+
+    auto complete = [&](io_uring_cqe* cqe){
+        size_t i   = (size_t)(uintptr_t)io_uring_cqe_get_data(cqe);
+        int    res = cqe->res;
+        io_uring_cqe_seen(&m_ring, cqe);
+        pending --;
+        files[i].busy = false;
+
+        if (res == -EINTR || res == -EAGAIN){
+            ready.push_back(i);
+        } else if (res == -EINVAL || res == -EOPNOTSUPP){
+            /* 内核不认识这个操作, 这个文件留给线程池 */
+            usable = false;
+            ready.push_back(i);
+        } else if (res <= 0){
+            fail(i);
+        } else {
+            files[i].done += res;
+            if (files[i].done < buffers[i].size()){
+                ready.push_back(i);
+            } else {
+                close(files[i].fd);
+                files[i].fd = -1;
+            }
+        }
+    };
+
+    while (usable && (!ready.empty() || pending > 0)){
+        /* 能提交多少就提交多少, 一次系统调用 */
+        while (!ready.empty() && pending < m_queueDepth){
+            io_uring_sqe* sqe = io_uring_get_sqe(&m_ring);
+            if (!sqe) break;
+
+            size_t i = ready.front();
+            ready.pop_front();
+            io_uring_prep_read(sqe, files[i].fd, buffers[i].data() + files[i].done,
+                               (unsigned)(buffers[i].size() - files[i].done), files[i].done);
+            io_uring_sqe_set_data(sqe, (void*)(uintptr_t)i);
+            files[i].busy = true;
+            pending ++;
+        }
+
+        int ret = io_uring_submit_and_wait(&m_ring, 1);
+        if (ret < 0 && ret != -EINTR && ret != -EAGAIN && ret != -EBUSY){
+            LOGW("[reader] io_uring_submit failed: %s", strerror(-ret));
+            usable = false;
+            break;
+        }
+
+        /* 把已经完成的全部收走 */
+        io_uring_cqe* cqe;
+        while (io_uring_peek_cqe(&m_ring, &cqe) == 0)
+            complete(cqe);
+    }
+
+    /*
+     * 出错之后不再提交, 但是内核已经拿走的read还会往buffers里写, 要等它们都完成才能返回
+     * 还留在SQ里没有被内核拿走的read不会再执行
+     */
+    unsigned owned = pending - io_uring_sq_ready(&m_ring);
+    while (owned > 0){
+        io_uring_cqe* cqe;
+        int ret = io_uring_wait_cqe(&m_ring, &cqe);
+        if (ret == -EINTR) continue;
+        if (ret < 0) break;
+        complete(cqe);
+        owned --;
+    }
+
+    /* 没有读完的文件都交给线程池重新读; 连等都等不到的read, 它的buffer不能释放, 先留着 */
+    for (size_t i = 0; i < paths.size(); i ++){
+        if (files[i].fd < 0) continue;
+        close(files[i].fd);
+        files[i].fd = -1;
+        if (files[i].busy) m_orphans.push_back(move(buffers[i]));
+        buffers[i].clear();
+        retry.push_back(i);
+    }
+    return usable;
+}
+#endif
+
+} // namespace batchio
@@ -0,0 +1,168 @@
+#include <cstring>
+#include "encoder.hpp"
+
+using namespace std;
+
+namespace encoder{
+
+namespace {
+
+bool encodeRaw(const cv::Mat& img, vector<uchar>& out){
+    if (img.type() != CV_8UC3) return false;
+
+    RawHeader header{};
+    memcpy(header.magic, "CPMRAW\0\0", sizeof(header.magic));
+    header.rows = img.rows;
+    header.cols = img.cols;
+
+    size_t row = size_t(img.cols) * img.elemSize();
+    out.resize(sizeof(header) + row * img.rows);
+    memcpy(out.data(), &header, sizeof(header));
+
+    /* 不连续的Mat(比如ROI)一行一行地拷 */
+    uchar* dst = out.data() + sizeof(header);
+    for (int r = 0; r < img.rows; r ++, dst += row)
+        memcpy(dst, img.ptr<uchar>(r), row);
+    return true;
+}
+
+/*
+ * QOI编码, 按照规范(qoi-specification.pdf)一个像素一个像素地处理:
+ *  和上一个像素相同的时候累计run, 在最近见过的64个像素里的时候写下标,
+ *  差值小的时候写1或2字节的差值, 否则写完整的RGB
+ *  输入是BGR, 写出去的是RGB, alpha总是255
+ */
+bool encodeQOI(const cv::Mat& img, vector<uchar>& out){
+    if (img.type() != CV_8UC3) return false;
+
+    enum : uint8_t {
+        OP_INDEX = 0x00,
+        OP_DIFF  = 0x40,
+        OP_LUMA  = 0x80,
+        OP_RUN   = 0xc0,
+        OP_RGB   = 0xfe,
+    };
+    struct Pixel{ uint8_t r, g, b, a; };
+
+    /* 最坏的情况每个像素4字节(OP_RGB), 先按最坏的情况分配, 最后再缩到实际大小 */
+    size_t pixels = size_t(img.rows) * img.cols;
+    out.resize(14 + pixels * 4 + 8);
+    uchar* p = out.data();
+
+    auto be32 = [&](uint32_t v){
+        *p ++ = v >> 24; *p ++ = v >> 16; *p ++ = v >> 8; *p ++ = v;
+    };
+    memcpy(p, "qoif", 4);
+    p += 4;
+    be32(img.cols);
+    be32(img.rows);
+    *p ++ = 3;    // channels: RGB
+    *p ++ = 0;    // colorspace: sRGB + linear alpha
+
+    Pixel index[64];
+    memset(index, 0, sizeof(index));
+    Pixel prev{0, 0, 0, 255};
+    int   run = 0;
+
+    for (int y = 0; y < img.rows; y ++){
+        const uchar* src = img.ptr<uchar>(y);
+        for (int x = 0; x < img.cols; x ++, src += 3){
+            Pixel px{src[2], src[1], src[0], 255};
+            bool  last = y == img.rows - 1 && x == img.cols - 1;
+
+            if (memcmp(&px, &prev, sizeof(px)) == 0){
+                run ++;
+                if (run == 62 || last){
+                    *p ++ = OP_RUN | (run - 1);
+                    run = 0;
+                }
+                continue;
+            }
+
+            if (run > 0){
+                *p ++ = OP_RUN | (run - 1);
+                run = 0;
+            }
+
+            int hash = (px.r * 3 + px.g * 5 + px.b * 7 + px.a * 11) % 64;
+            if (memcmp(&index[hash], &px, sizeof(px)) == 0){
+                *p ++ = OP_INDEX | hash;
+            } else {
+                index[hash] = px;
+
+                /* alpha总是255, 不会用到OP_RGBA */
+                int8_t vr   = (int8_t)(px.r - prev.r);
+                int8_t vg   = (int8_t)(px.g - prev.g);
+                int8_t vb   = (int8_t)(px.b - prev.b);
+                int8_t vg_r = (int8_t)(vr - vg);
+                int8_t vg_b = (int8_t)(vb - vg);
+
+                if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2){
+                    *p ++ = OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2);
+                } else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 && vg_b > -9 && vg_b < 8){
+                    *p ++ = OP_LUMA | (vg + 32);
+                    *p ++ = (vg_r + 8) << 4 | (vg_b + 8);
+                } else {
+                    *p ++ = OP_RGB;
+                    *p ++ = px.r;
+                    *p ++ = px.g;
+                    *p ++ = px.b;
+                }
+            }
+            prev = px;
+        }
+    }
+
+    /* 结尾: 7个0x00和一个0x01 */
+    static const uchar kPadding[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+    memcpy(p, kPadding, sizeof(kPadding));
+    p += sizeof(kPadding);
+
+    out.resize(p - out.data());
+    return true;
+}
+
+} // namespace
+
+const char* name(Format format){
+    switch (format){
+        case Format::PNG:  return "png";
+        case Format::JPEG: return "jpeg";
+        case Format::Raw:  return "raw";
+        case Format::QOI:  return "qoi";
+    }
+    return "unknown";
+}
+
+const char* extension(Format format){
+    switch (format){
+        case Format::PNG:  return ".png";
+        case Format::JPEG: return ".jpg";
+        case Format::Raw:  return ".raw";
+        case Format::QOI:  return ".qoi";
+    }
+    return "";
+}
+
+bool encode(const cv::Mat& img, const Options& options, vector<uchar>& out){
+    out.clear();
+    if (img.empty()) return false;
+
+    switch (options.format){
+        case Format::PNG: {
+            vector<int> params;
+            if (options.pngLevel >= 0)
+                params = {cv::IMWRITE_PNG_COMPRESSION, options.pngLevel};
+            return cv::imencode(".png", img, out, params);
+        }
+        case Format::JPEG:
+            return cv::imencode(".jpg", img, out, {cv::IMWRITE_JPEG_QUALITY, options.jpegQuality});
+        case Format::Raw:
+            return encodeRaw(img, out);
+        case Format::QOI:
+            return encodeQOI(img, out);
+    }
+    return false;
+}
+
+} // namespace encoder
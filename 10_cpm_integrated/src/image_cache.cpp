@@ -0,0 +1,68 @@
+#include "image_cache.hpp"
+#include "logger.hpp"
+
+using namespace std;
+
+namespace imgcache{
+
+ImageCache::ImageCache(size_t capacityBytes) : m_capacity(capacityBytes) {}
+
+bool ImageCache::get(const string& path, cv::Mat& img){
+    if (!enabled()) return false;
+
+    lock_guard<mutex> lock(m_mtx);
+    auto it = m_index.find(path);
+    if (it == m_index.end()){
+        m_misses ++;
+        return false;
+    }
+
+    /* 挪到最前面, 最近用过 */
+    m_lru.splice(m_lru.begin(), m_lru, it->second);
+    img = it->second->img;
+    m_hits ++;
+    return true;
+}
+
+void ImageCache::put(const string& path, const cv::Mat& img){
+    size_t bytes = img.total() * img.elemSize();
+    if (!enabled() || img.empty() || bytes > m_capacity) return;
+
+    lock_guard<mutex> lock(m_mtx);
+
+    /* 两个解码线程同时miss了同一张图片, 后来的直接覆盖 */
+    auto it = m_index.find(path);
+    if (it != m_index.end()){
+        m_bytes -= it->second->bytes;
+        m_lru.erase(it->second);
+        m_index.erase(it);
+    }
+
+    while (m_bytes + bytes > m_capacity && !m_lru.empty()){
+        Entry& victim = m_lru.back();
+        m_bytes -= victim.bytes;
+        m_index.erase(victim.path);
+        m_lru.pop_back();
+        m_evictions ++;
+    }
+
+    m_lru.push_front(Entry{path, img, bytes});
+    m_index[path] = m_lru.begin();
+    m_bytes += bytes;
+}
+
+size_t ImageCache::bytes() const{
+    lock_guard<mutex> lock(m_mtx);
+    return m_bytes;
+}
+
+void ImageCache::report() const{
+    if (!enabled()) return;
+
+    long total = hits() + misses();
+    LOG("[cache] hits %ld, misses %ld (%.1f%% hit), evictions %ld, %.1f / %.1f MB",
+        hits(), misses(), total > 0 ? 100.0 * hits() / total : 0.0, evictions(),
+        bytes() / 1048576.0, m_capacity / 1048576.0);
+}
+
+} // namespace imgcache
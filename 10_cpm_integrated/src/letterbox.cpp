@@ -0,0 +1,284 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "letterbox.hpp"
+#include "preprocess.hpp"
+#include "logger.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#include <immintrin.h>
+#define LETTERBOX_X86 1
+#endif
+
+using namespace std;
+
+namespace preprocess{
+
+namespace {
+
+/*
+ * 这里完全按照OpenCV里8U的INTER_LINEAR来做:
+ *  水平方向: D = S[sx] * a0 + S[sx + cn] * a1, 系数是11bit的定点数(1.0 == 2048), 结果存成int
+ *  垂直方向: OpenCV的SIMD实现(128bit)是
+ *              ((S0 >> 4) * b0 >> 16) + ((S1 >> 4) * b1 >> 16) + 2) >> 2
+ *            一行里SIMD处理不到的尾巴是标量实现
+ *              (S0 * b0 + S1 * b1 + (1 << 21)) >> 22
+ *  两种写法最多差1, 所以这里对同样的位置用同样的写法, 才能和cv::resize逐字节一致
+ */
+struct Impl{
+    VResizeFunc func;
+    const char* name;
+};
+
+inline short coef(float v){
+    int i = (int)lrintf(v);
+    return (short)std::max(-32768, std::min(32767, i));
+}
+
+inline int sat16(int v){
+    return std::max(-32768, std::min(32767, v));
+}
+
+inline uchar sat8(int v){
+    return (uchar)std::max(0, std::min(255, v));
+}
+
+// OpenCV的vresize在128bit SIMD下能处理到的位置: 先按16个一组, 再按8个一组(严格小于)
+inline int simd_limit(int width){
+    int x = width / 16 * 16;
+    if (width - x > 8) x += 8;
+    return x;
+}
+
+inline uchar vlinear_simd(int s0, int s1, int b0, int b1){
+    int r = sat16(((sat16(s0 >> 4) * b0) >> 16) + ((sat16(s1 >> 4) * b1) >> 16));
+    return sat8(sat16(r + 2) >> 2);
+}
+
+inline uchar vlinear_scalar(int s0, int s1, int b0, int b1){
+    return sat8((s0 * b0 + s1 * b1 + (1 << (kCoefBits * 2 - 1))) >> (kCoefBits * 2));
+}
+
+void vresize_tail(const int* S0, const int* S1, uchar* dst, int x, int width, int b0, int b1){
+    int limit = simd_limit(width);
+    for (; x < limit; x ++) dst[x] = vlinear_simd(S0[x], S1[x], b0, b1);
+    for (; x < width; x ++) dst[x] = vlinear_scalar(S0[x], S1[x], b0, b1);
+}
+
+void vresize_scalar(const int* S0, const int* S1, uchar* dst, int width, int b0, int b1){
+    vresize_tail(S0, S1, dst, 0, width, b0, b1);
+}
+
+#ifdef LETTERBOX_X86
+void vresize_sse2(const int* S0, const int* S1, uchar* dst, int width, int b0, int b1){
+    int     limit = simd_limit(width);
+    __m128i vb0   = _mm_set1_epi16((short)b0);
+    __m128i vb1   = _mm_set1_epi16((short)b1);
+    __m128i two   = _mm_set1_epi16(2);
+
+    int x = 0;
+    for (; x + 8 <= limit; x += 8){
+        __m128i a = _mm_packs_epi32(_mm_srai_epi32(_mm_loadu_si128((const __m128i*)(S0 + x)), 4),
+                                    _mm_srai_epi32(_mm_loadu_si128((const __m128i*)(S0 + x + 4)), 4));
+        __m128i b = _mm_packs_epi32(_mm_srai_epi32(_mm_loadu_si128((const __m128i*)(S1 + x)), 4),
+                                    _mm_srai_epi32(_mm_loadu_si128((const __m128i*)(S1 + x + 4)), 4));
+        __m128i r = _mm_adds_epi16(_mm_mulhi_epi16(a, vb0), _mm_mulhi_epi16(b, vb1));
+        r = _mm_srai_epi16(_mm_adds_epi16(r, two), 2);
+        _mm_storel_epi64((__m128i*)(dst + x), _mm_packus_epi16(r, r));
+    }
+    vresize_tail(S0, S1, dst, x, width, b0, b1);
+}
+
+__attribute__((target("avx2")))
+void vresize_avx2(const int* S0, const int* S1, uchar* dst, int width, int b0, int b1){
+    int     limit = simd_limit(width);
+    __m256i vb0   = _mm256_set1_epi16((short)b0);
+    __m256i vb1   = _mm256_set1_epi16((short)b1);
+    __m256i two   = _mm256_set1_epi16(2);
+
+    int x = 0;
+    for (; x + 16 <= limit; x += 16){
+        /* packs是按128bit的lane分别做的, permute回原来的顺序 */
+        __m256i a = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_loadu_si256((const __m256i*)(S0 + x)), 4),
+                                       _mm256_srai_epi32(_mm256_loadu_si256((const __m256i*)(S0 + x + 8)), 4));
+        __m256i b = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_loadu_si256((const __m256i*)(S1 + x)), 4),
+                                       _mm256_srai_epi32(_mm256_loadu_si256((const __m256i*)(S1 + x + 8)), 4));
+        a = _mm256_permute4x64_epi64(a, 0xD8);
+        b = _mm256_permute4x64_epi64(b, 0xD8);
+        __m256i r = _mm256_adds_epi16(_mm256_mulhi_epi16(a, vb0), _mm256_mulhi_epi16(b, vb1));
+        r = _mm256_srai_epi16(_mm256_adds_epi16(r, two), 2);
+        _mm_storeu_si128((__m128i*)(dst + x),
+                         _mm_packus_epi16(_mm256_castsi256_si128(r), _mm256_extracti128_si256(r, 1)));
+    }
+    vresize_tail(S0, S1, dst, x, width, b0, b1);
+}
+#endif
+
+vector<Impl> available_impls(){
+    vector<Impl> impls;
+    impls.push_back({vresize_scalar, "scalar"});
+#ifdef LETTERBOX_X86
+    impls.push_back({vresize_sse2, "sse2"});
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        impls.push_back({vresize_avx2, "avx2"});
+#endif
+    return impls;
+}
+
+// 第一次调用的时候选择当前CPU支持的最快的实现
+const Impl& best_impl(){
+    static const Impl impl = available_impls().back();
+    return impl;
+}
+
+// HWC的uint8结果: 左pad + resize + 右pad, resize的结果直接写进dst, 这一行只写一次
+struct HWCWriter{
+    cv::Mat& dst;
+    int      target_w;
+    int      left;
+    int      width;
+    bool     swapRB;
+
+    void pad(int dy){
+        memset(dst.ptr<uchar>(dy), 0, target_w * 3);
+    }
+
+    uchar* span(int dy){
+        return dst.ptr<uchar>(dy) + left;
+    }
+
+    void commit(int dy, uchar* span){
+        uchar* out = dst.ptr<uchar>(dy);
+        memset(out, 0, left);
+        memset(out + left + width, 0, target_w * 3 - left - width);
+        if (swapRB){
+            for (int i = 0; i < width; i += 3) std::swap(span[i], span[i + 2]);
+        }
+    }
+};
+
+void letterbox_impl(const cv::Mat& src, cv::Mat& dst, int target_w, int target_h, bool swapRB, VResizeFunc vresize){
+    Geometry g = letterbox_geometry(src.cols, src.rows, target_w, target_h);
+    dst.create(target_h, target_w, CV_8UC3);
+
+    HWCWriter writer{dst, target_w, g.x * 3, g.new_w * 3, swapRB};
+    letterbox_rows(src, g, target_h, vresize, writer);
+}
+
+} // namespace
+
+Geometry letterbox_geometry(int input_w, int input_h, int target_w, int target_h){
+    Geometry g;
+    float scale = std::min(float(target_w)/input_w, float(target_h)/input_h);
+    g.new_w = int(input_w * scale);
+    g.new_h = int(input_h * scale);
+    g.x     = (g.new_w < target_w) ? (target_w - g.new_w) / 2 : 0;
+    g.y     = (g.new_h < target_h) ? (target_h - g.new_h) / 2 : 0;
+    return g;
+}
+
+void build_resize_tables(ResizeTables& t, int src_w, int src_h, int dst_w, int dst_h){
+    if (t.src_w == src_w && t.src_h == src_h && t.dst_w == dst_w && t.dst_h == dst_h)
+        return;
+
+    t.src_w = src_w; t.src_h = src_h;
+    t.dst_w = dst_w; t.dst_h = dst_h;
+    t.xofs.resize(dst_w);
+    t.alpha.resize(dst_w * 2);
+    t.yofs.resize(dst_h);
+    t.beta.resize(dst_h * 2);
+
+    double scale_x = 1. / ((double)dst_w / src_w);
+    double scale_y = 1. / ((double)dst_h / src_h);
+
+    t.xmax = dst_w;
+    for (int dx = 0; dx < dst_w; dx ++){
+        float fx = (float)((dx + 0.5) * scale_x - 0.5);
+        int   sx = (int)floorf(fx);
+        fx -= sx;
+
+        if (sx < 0){
+            fx = 0, sx = 0;
+        }
+        if (sx + 1 >= src_w){
+            t.xmax = std::min(t.xmax, dx);
+            if (sx >= src_w - 1)
+                fx = 0, sx = src_w - 1;
+        }
+        t.xofs[dx]          = sx * 3;
+        t.alpha[dx * 2]     = coef((1.f - fx) * kCoefScale);
+        t.alpha[dx * 2 + 1] = coef(fx * kCoefScale);
+    }
+
+    for (int dy = 0; dy < dst_h; dy ++){
+        float fy = (float)((dy + 0.5) * scale_y - 0.5);
+        int   sy = (int)floorf(fy);
+        fy -= sy;
+
+        t.yofs[dy]         = sy;
+        t.beta[dy * 2]     = coef((1.f - fy) * kCoefScale);
+        t.beta[dy * 2 + 1] = coef(fy * kCoefScale);
+    }
+}
+
+VResizeFunc vresize_kernel(){
+    return best_impl().func;
+}
+
+void letterbox_nchw(const cv::Mat& src, float* dst, int target_w, int target_h, bool swapRB){
+    if (swapRB)
+        LetterboxNCHW::run(src, dst, target_w, target_h);
+    else
+        Pipeline<Linear, Pad<0>, BGR, Identity, CHW<float>>::run(src, dst, target_w, target_h);
+}
+
+void letterbox_opencv(const cv::Mat& src, cv::Mat& dst, int target_w, int target_h){
+    Geometry g = letterbox_geometry(src.cols, src.rows, target_w, target_h);
+
+    cv::Mat tar(target_h, target_w, CV_8UC3, cv::Scalar(0, 0, 0));
+    cv::Mat tmp;
+    cv::resize(src, tmp, cv::Size(g.new_w, g.new_h));
+
+    cv::Rect roi(g.x, g.y, g.new_w, g.new_h);
+    cv::Mat roiOfTar = tar(roi);
+    tmp.copyTo(roiOfTar);
+
+    cv::cvtColor(tar, tar, cv::COLOR_BGR2RGB);
+    cv::cvtColor(tar, tar, cv::COLOR_RGB2BGR);
+    dst = tar;
+}
+
+void letterbox(const cv::Mat& src, cv::Mat& dst, int target_w, int target_h, bool swapRB){
+    letterbox_impl(src, dst, target_w, target_h, swapRB, best_impl().func);
+}
+
+long letterbox_check(const cv::Mat& src, int target_w, int target_h){
+    cv::Mat ref;
+    letterbox_opencv(src, ref, target_w, target_h);
+
+    long total = 0;
+    for (auto& impl: available_impls()){
+        cv::Mat out;
+        letterbox_impl(src, out, target_w, target_h, false, impl.func);
+
+        long diff = 0;
+        for (int r = 0; r < target_h; r ++){
+            const uchar* a = ref.ptr<uchar>(r);
+            const uchar* b = out.ptr<uchar>(r);
+            for (int i = 0; i < target_w * 3; i ++) diff += a[i] != b[i];
+        }
+        if (diff != 0)
+            LOGW("[letterbox] %s differs from OpenCV in %ld bytes (%dx%d -> %dx%d)",
+                impl.name, diff, src.cols, src.rows, target_w, target_h);
+        total += diff;
+    }
+    return total;
+}
+
+const char* simd_name(){
+    return best_impl().name;
+}
+
+} // namespace preprocess
@@ -1,5 +1,12 @@
 #include <string>
-#include <iostream>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <condition_variable>
 #include <stdarg.h>
 #include "logger.hpp"
 #include "time.h"
@@ -7,74 +14,248 @@
 using namespace std;
 namespace logger
 {
-    LogLevel g_level = LogLevel::Info;
-
-    string time_now(){
-        time_t timep;
-        char time_string[20];
-        // 获取现在的时间
-        time(&timep);
-        tm &t = *localtime(&timep);
-        snprintf(time_string, sizeof(time_string), 
-            "%04d-%02d-%02d %02d:%02d:%02d", 
+    /*
+     * 异步的日志:
+     *  每个线程第一次打日志的时候分配一个自己的环形队列(单生产者单消费者, 无锁)
+     *  调用者只做一次vsnprintf, 把消息, 等级和时间戳写进队列里一个定长的槽, 不拿锁也不碰stdio
+     *  后台线程每隔kInterval把所有队列里的记录取出来按时间排好, 加上时间和等级的前缀, 一次fwrite写出去
+     *  队列满了这一条就丢掉, 只记个数, 调用者不会被终端的I/O卡住; 丢了多少由后台线程下一次写出去的时候报告
+     *  Error/Fatal在abort之前同步地flush, 进程退出的时候静态对象的析构也会flush
+     */
+    constexpr size_t kMessageBytes = 496;    // 一条消息最长的字节数, 更长的会被截断
+    constexpr size_t kRingSlots    = 256;    // 每个线程的队列长度
+    constexpr auto   kInterval     = chrono::milliseconds(20);
+
+    struct Record{
+        int64_t  time;          // system_clock, 纳秒
+        LogLevel level;
+        char     message[kMessageBytes];
+    };
+
+    struct Ring{
+        Record         slots[kRingSlots];
+        atomic<size_t> head{0};         // 只有打日志的线程写
+        char           pad0[64];
+        atomic<size_t> tail{0};         // 只有后台线程写
+        char           pad1[64];
+        atomic<long>   dropped{0};
+        atomic<bool>   alive{true};     // 线程退出之后, 队列空了就可以回收
+    };
+
+    LogLevel     g_level = LogLevel::Info;
+    atomic<bool> g_closed{false};       // 后台线程已经停了, 之后的日志同步地写
+    atomic<long> g_dropped{0};
+
+    int64_t time_now(){
+        return chrono::duration_cast<chrono::nanoseconds>(
+            chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    // localtime不是线程安全的, 这里用localtime_r
+    void time_string(int64_t time, char (&out)[20]){
+        time_t timep = (time_t)(time / 1000000000);
+        tm t;
+        localtime_r(&timep, &t);
+        snprintf(out, sizeof(out),
+            "%04d-%02d-%02d %02d:%02d:%02d",
             t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec);
-        return time_string;
     }
 
-    // 注意，c++中的string是一个类，所以如果想要打印的话，需要使用c_str()
-    string level_string(LogLevel level){
+    const char* level_string(LogLevel level){
         switch (level){
-        case LogLevel::Debug:   return "debug";
-        case LogLevel::Verbose: return "verb";
-        case LogLevel::Info:    return "info";
-        case LogLevel::Warning: return "warn";
-        case LogLevel::Error:   return "error";
-        case LogLevel::Fatal:   return "fatal";
-        default: return "unknown";
+        case LogLevel::Debug:   return DGREEN "[debug]" CLEAR;
+        case LogLevel::Verbose: return PURPLE "[verb]"  CLEAR;
+        case LogLevel::Info:    return GREEN  "[info]"  CLEAR;
+        case LogLevel::Warning: return BLUE   "[warn]"  CLEAR;
+        case LogLevel::Error:   return RED    "[error]" CLEAR;
+        case LogLevel::Fatal:   return RED    "[fatal]" CLEAR;
+        default: return "[unknown]";
         }
     }
+
+    // 把一条记录格式化成一行, 追加到text后面
+    void append_line(string& text, int64_t time, LogLevel level, const char* message){
+        char now[20];
+        time_string(time, now);
+        text += YELLOW "[";
+        text += now;
+        text += "]" CLEAR;
+        text += level_string(level);
+        text += message;
+        text += '\n';
+    }
+
+    void write_out(const string& text){
+        if (text.empty()) return;
+        fwrite(text.data(), 1, text.size(), stdout);
+        fflush(stdout);
+    }
+
+    class Backend{
+    public:
+        Backend(){
+            m_worker = thread(&Backend::run, this);
+        }
+
+        ~Backend(){
+            // 先切到同步模式, 再停后台线程, 停之前会把所有队列里剩下的记录都写出去
+            g_closed = true;
+            {
+                lock_guard<mutex> l(m_lock);
+                m_running = false;
+            }
+            m_wake.notify_one();
+            m_worker.join();
+        }
+
+        shared_ptr<Ring> attach(){
+            auto ring = make_shared<Ring>();
+            lock_guard<mutex> l(m_lock);
+            m_rings.push_back(ring);
+            return ring;
+        }
+
+        // 等到调用之前已经进了队列的记录都写出去
+        void flush(){
+            unique_lock<mutex> l(m_lock);
+            if (!m_running) return;
+            long ticket = ++ m_requested;
+            m_wake.notify_one();
+            m_done.wait(l, [&]{ return m_flushed >= ticket || !m_running; });
+        }
+
+    private:
+        void run(){
+            vector<shared_ptr<Ring>> rings;
+            vector<Record>           batch;
+            string                   text;
+
+            unique_lock<mutex> l(m_lock);
+            for (;;){
+                m_wake.wait_for(l, kInterval, [&]{ return m_requested > m_flushed || !m_running; });
+                long ticket  = m_requested;
+                bool running = m_running;
+                rings        = m_rings;
+                l.unlock();
+
+                drain(rings, batch, text);
+                rings.clear();
+
+                l.lock();
+                // 已经退出的线程, 队列也空了, 就不再检查它
+                m_rings.erase(remove_if(m_rings.begin(), m_rings.end(), [](const shared_ptr<Ring>& r){
+                    return !r->alive && r->head.load(memory_order_acquire) == r->tail.load(memory_order_relaxed);
+                }), m_rings.end());
+                m_flushed = ticket;
+                m_done.notify_all();
+                if (!running) break;
+            }
+        }
+
+        void drain(const vector<shared_ptr<Ring>>& rings, vector<Record>& batch, string& text){
+            batch.clear();
+            long dropped = 0;
+            for (auto& ring: rings){
+                size_t tail = ring->tail.load(memory_order_relaxed);
+                size_t head = ring->head.load(memory_order_acquire);
+                for (; tail != head; tail ++)
+                    batch.push_back(ring->slots[tail % kRingSlots]);
+                ring->tail.store(tail, memory_order_release);
+                dropped += ring->dropped.exchange(0, memory_order_relaxed);
+            }
+
+            // 不同线程的记录按时间交错, 同一个线程的记录保持原来的顺序
+            stable_sort(batch.begin(), batch.end(), [](const Record& a, const Record& b){
+                return a.time < b.time;
+            });
+
+            text.clear();
+            if (dropped > 0){
+                g_dropped += dropped;
+                char message[64];
+                snprintf(message, sizeof(message), "logger dropped %ld records, the ring was full", dropped);
+                append_line(text, time_now(), LogLevel::Warning, message);
+            }
+            for (auto& r: batch)
+                append_line(text, r.time, r.level, r.message);
+            write_out(text);
+        }
+
+        mutex                    m_lock;
+        condition_variable       m_wake;
+        condition_variable       m_done;
+        vector<shared_ptr<Ring>> m_rings;
+        bool                     m_running{true};
+        long                     m_requested{0};
+        long                     m_flushed{0};
+        thread                   m_worker;
+    };
+
+    // 第一次打日志的时候才创建后台线程, 进程退出的时候析构
+    Backend& backend(){
+        static Backend instance;
+        return instance;
+    }
+
+    // 每个线程自己的队列, 线程退出的时候标记一下, 剩下的记录还是会被写出去
+    struct Producer{
+        shared_ptr<Ring> ring;
+        ~Producer(){
+            if (ring) ring->alive = false;
+        }
+    };
+    thread_local Producer t_producer;
+
     void set_log_level(LogLevel level){
         g_level = level;
     }
+
+    void flush(){
+        if (!g_closed) backend().flush();
+    }
+
+    long dropped(){
+        return g_dropped;
+    }
+
     void __make_log(const char* file, int line, LogLevel level, const char* format, ... ){
-        // 如果是verbose的话就取消？
         if (level > g_level) return;
         // 定义一个char*类型的vl，用来指向可变参数
         va_list vl;
         // 通过va_start开始存放从format开始之后的第一个参数
         va_start(vl, format);
 
-        char buff[2000];
-        int n = 0;
-        auto now = time_now();
-        // print time
-        n += snprintf(buff + n, sizeof(buff) - n, YELLOW "[%s]" CLEAR, now.c_str());
-
-        // print log level
-        if (level == LogLevel::Debug){
-            n += snprintf(buff + n, sizeof(buff) - n, DGREEN "[%s]" CLEAR, level_string(level).c_str());
-        }else if (level == LogLevel::Verbose){
-            n += snprintf(buff + n, sizeof(buff) - n, PURPLE "[%s]" CLEAR, level_string(level).c_str());
-        }else if (level == LogLevel::Info){
-            n += snprintf(buff + n, sizeof(buff) - n, GREEN  "[%s]" CLEAR, level_string(level).c_str());
-        }else if (level == LogLevel::Warning){
-            n += snprintf(buff + n, sizeof(buff) - n, BLUE   "[%s]" CLEAR, level_string(level).c_str());
-        }else if (level == LogLevel::Error || level == LogLevel::Fatal){
-            n += snprintf(buff + n, sizeof(buff) - n, RED    "[%s]" CLEAR, level_string(level).c_str());
+        // Error/Fatal要保证写出去: 先把之前的日志都flush掉, 再同步地写这一条, 然后abort
+        // 后台线程已经停了(静态对象析构之后)的日志也同步地写
+        bool fatal = level == LogLevel::Error || level == LogLevel::Fatal;
+        if (fatal || g_closed){
+            char message[kMessageBytes];
+            vsnprintf(message, sizeof(message), format, vl);
+            va_end(vl);
+
+            if (fatal) flush();
+            string text;
+            append_line(text, time_now(), level, message);
+            write_out(text);
+            if (fatal) abort();
+            return;
         }
 
-        // print file and line
-        // n += snprintf(buff + n, sizeof(buff) - n, "[%s:%d]", file, line);
+        if (!t_producer.ring)
+            t_producer.ring = backend().attach();
 
-        // print va_args
-        n += vsnprintf(buff + n, sizeof(buff) - n, format, vl);
-        fprintf(stdout, "%s\n", buff);
+        Ring*  ring = t_producer.ring.get();
+        size_t head = ring->head.load(memory_order_relaxed);
+        if (head - ring->tail.load(memory_order_acquire) >= kRingSlots){
+            ring->dropped.fetch_add(1, memory_order_relaxed);
+        }else{
+            Record& r = ring->slots[head % kRingSlots];
+            r.time  = time_now();
+            r.level = level;
+            vsnprintf(r.message, sizeof(r.message), format, vl);
+            ring->head.store(head + 1, memory_order_release);
+        }
         // free va_list
         va_end(vl);
-        
-        if (level == LogLevel::Error || level == LogLevel::Fatal){
-            fflush(stdout);
-            abort();
-        }
     }
 } // namespace logger
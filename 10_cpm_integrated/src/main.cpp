@@ -32,7 +32,8 @@ string imgPaths[20] = {
 int main(){
     logger::set_log_level(logger::LogLevel::Info);
 
-    auto producer = model::create_model(imgPaths, 20);
+    // 每张图片重复出现了4次, 只有第一次需要读文件和解码, 其余的从256MB的缓存里取
+    auto producer = model::create_model(imgPaths, 20, jobqueue::QueueType::Ring, 2, 256 << 20);
     auto results  = producer->commits();
 
     for (auto& res: results){
@@ -1,6 +1,11 @@
 #include "model.hpp"
 #include "logger.hpp"
 #include "utils.hpp"
+#include "preprocess.hpp"
+#include "writer.hpp"
+#include "batch_reader.hpp"
+#include "image_cache.hpp"
+#include "image_probe.hpp"
 #include <vector>
 #include <future>
 #include <thread>
@@ -9,6 +14,7 @@
 #include <memory>
 #include <queue>
 #include <chrono>
+#include <unordered_map>
 #include "opencv2/highgui.hpp"
 #include "opencv2/opencv.hpp"
 
@@ -16,6 +22,13 @@ using namespace std;
 
 namespace model{
 
+/* 
+ * 消费者用的预处理流水线, 在编译期展开成一个循环:
+ *  双线性resize + 0填充的letterbox, 保持BGR, 不做归一化, 输出HWC的uint8
+ *  换一种网络的输入(比如RGB, NCHW, 归一化)只需要换这里的策略
+ */
+using ImagePipeline = preprocess::LetterboxBGR;
+
 // img记录了图片数据和他们相对应的路径
 struct Job{
     img src;
@@ -25,8 +38,16 @@ struct Job{
 class ModelImpl : public Model{
 
 public:
-    ModelImpl(string* img_list, int batchSize):
-        m_imgPaths(img_list), m_batchSize(batchSize){};
+    ModelImpl(string* img_list, int batchSize, jobqueue::QueueType queueType, int numWriters, size_t cacheBytes,
+              const encoder::Options& encode):
+        m_imgPaths(img_list), m_batchSize(batchSize),
+        m_jobQueue(jobqueue::create_queue<Job>(queueType, batchSize, batchSize)),
+        m_reader(batchSize),
+        m_cache(cacheBytes),
+        /* 最多积压两个batch的结果, 再多消费者就要等writer */
+        m_writer(new writer::AsyncWriter(numWriters, batchSize * 2, encode)){
+        LOG("[producer] reading images with %s", m_reader.backend());
+    };
 
     /* 
      * 析构函数:
@@ -40,20 +61,28 @@ public:
         /* 如果正在执行，那么就停止 */
         if (m_running){
             m_running = false;
-            // notify_all 被用来通知所有等待在条件变量 m_cv 上的线程，
+            // close会唤醒所有阻塞在jobQueue上的线程，
             // 这些线程可能正在等待某个条件（例如，队列中有新任务可处理）。
-            // notify_all 唤醒所有等待的线程，以便它们能够重新评估等待条件，并且在发现 m_running 
-            // 被设置为 false 后，可以安全地退出等待循环和终止它们的工作
-            m_cv.notify_all();
+            // 被唤醒的consumer会把jobQueue里剩下的job处理完，
+            // 发现jobQueue已经被close并且为空之后，就可以安全地退出循环和终止它们的工作
+            m_jobQueue->close();
         }
 
         /* 对于所有线程进行join处理 */
-        for (int i = 0; i < m_batchSize; i ++){
+        for (int i = 0; i < (int)m_workers.size(); i ++){
             if (m_workers[i].joinable()){
                 LOGV(DGREEN"[consumer] consumer%d release" CLEAR, i);
                 m_workers[i].join();
             }
         }
+
+        /* 消费者都退出之后不会再有新的结果, 把writer里剩下的图片都写完 */
+        if (m_writer){
+            m_writer->stop();
+            m_writer->report();
+            m_writer.reset();
+            m_cache.report();
+        }
     }
 
     /*
@@ -67,7 +96,7 @@ public:
         for (int i = 0; i < m_batchSize; i ++){
             // 在多线程环境中，成员函数 inference 必须知道它操作的是哪个对象实例。
             // 因此，需要将 this 指针传递给线程，以便线程能够正确地调用成员函数并访问对象的成员变量。
-            m_workers.emplace_back(thread(&ModelImpl::inference, this));
+            m_workers.emplace_back(thread(&ModelImpl::inference, this, i));
             LOGV(GREEN"[producer]created consumer%d" CLEAR, i);
         }
         return true;
@@ -82,24 +111,45 @@ public:
         vector<Job> jobs(m_batchSize);
         vector<shared_future<img>> futures(m_batchSize);
 
+        /* 
+         * 先查缓存, 没有命中的图片在这个batch里去重之后才读文件:
+         *  同一个batch里重复出现的图片也只读一次, 解码一次
+         *  一次把这些文件都读进内存(io_uring或者线程池), 之后从内存里解码并放进缓存
+         */
+        vector<string> misses;
+        unordered_map<string, cv::Mat> decoded;
+        for (int i = 0; i < m_batchSize; i ++){
+            const string& path = m_imgPaths[i];
+            if (decoded.count(path) || m_cache.get(path, jobs[i].src.data)) continue;
+            decoded[path];
+            misses.push_back(path);
+        }
+
+        m_reader.read(misses, m_buffers);
+        for (size_t i = 0; i < misses.size(); i ++){
+            cv::Mat& data = decoded[misses[i]];
+            if (!m_buffers[i].empty()){
+                /* 比letterbox之后大很多的JPEG直接解码成1/2, 1/4或者1/8, 后面的resize也更快 */
+                int flag = imgprobe::decode_flag(m_buffers[i].data(), m_buffers[i].size(), m_targetW, m_targetH);
+                data = cv::imdecode(m_buffers[i], flag);
+            }
+            if (data.empty())
+                LOGW("[producer] failed to read %s", misses[i].c_str());
+            m_cache.put(misses[i], data);
+        }
+        LOGV(BLUE"[producer] decoded %zu of %d images" CLEAR, misses.size(), m_batchSize);
+
         /* 设置一批job, 并对每一个job的promise设置对应的future */
         for (int i = 0; i < m_batchSize; i ++){
-            jobs[i].src.data = cv::imread(m_imgPaths[i]);
+            if (jobs[i].src.data.empty())
+                jobs[i].src.data = decoded[m_imgPaths[i]];
             jobs[i].src.path = m_imgPaths[i];
             jobs[i].tar.reset(new promise<img>());
             futures[i] = jobs[i].tar->get_future();
         }
 
-        /* 对jobQueue进行原子push */
-        {
-            lock_guard<mutex> lock(m_mtx);
-            for (int i = 0; i < m_batchSize; i ++){
-                m_jobQueue.emplace(move(jobs[i]));
-            }
-        }
-
-        /* 唤醒所有堵塞的consumer */
-        m_cv.notify_all();
+        /* 把一整个batch的job放进jobQueue, 并唤醒堵塞的consumer */
+        m_jobQueue->push_bulk(jobs);
 
         LOGV(BLUE"[producer]finished commits" CLEAR);
         return futures;
@@ -111,77 +161,43 @@ public:
      *  只要jobQueue有数据，就处理job, 并更新job内部的promise
      *  可以多个consumer处理同一个jobQueue
     */
-    void inference() {
+    void inference(int worker) {
         while(m_running){
             Job job;
             img result;
 
-            /* 对jobQueue进行原子pop */
-            {
-                unique_lock<mutex> lock(m_mtx);
-
-                /* 
-                 * consumer不被阻塞只有两种情况：
-                 *  1. jobQueue不是空，这个时候需要consumer去consume
-                 *  2. model已经被析构了，所有的线程都需要停止
-                 *
-                 * 所以，相应的condition_variable的notify也需要有两个
-                 *  1. 当jobQueue已经填好了数据的时候
-                 *  2. 当model已经被析构的时候
-                 */
-                m_cv.wait(lock, [&](){
-                    return !m_running || !m_jobQueue.empty();
-                });
-
-                /* 如果model已经被析构了，就跳出循环, 不再consume了*/
-                if (!m_running) break;
-
-                job = m_jobQueue.front();
-                m_jobQueue.pop();
-            }
+            /* 
+             * 从jobQueue里pop一个job, consumer不被阻塞只有两种情况：
+             *  1. jobQueue不是空，这个时候需要consumer去consume
+             *  2. model已经被析构了，jobQueue被close并且已经取空了，所有的线程都需要停止
+             */
+            if (!m_jobQueue->pop(worker, job)) break;
             LOGV(DGREEN"[consumer] Consumer processing %s" CLEAR, job.src.path.c_str());
 
+            /* 读不了的图片没有结果, 直接返回一个空的img */
+            if (job.src.data.empty()){
+                job.tar->set_value(result);
+                continue;
+            }
+
             /*
              * 对取出来的job数据进行处理，并更新promise
              * 这里面对应着batched inference之后的各个task的postprocess
              * 由于相比于GPU上的操作，这里的postprocess一般会在CPU上操作，所以会比较慢
              * 因此可以选择考虑多线程异步执行
-             * 这里为了达到耗时效果，选择在CPU端做如下操作:
-             *  1. letterbox resize
-             *  2. bgr2rgb
-             *  3. rgb2bgr
+             * 这里为了达到耗时效果，选择在CPU端做letterbox resize
+             * 原来的 letterbox -> bgr2rgb -> rgb2bgr 由ImagePipeline在一个循环里完成
              */
-            auto image = job.src.data;
+            cv::Mat tar;
+            ImagePipeline::run(job.src.data, tar, m_targetW, m_targetH);
 
-            int   input_w  = image.cols;
-            int   input_h  = image.rows;
-            int   target_w = 800;
-            int   target_h = 800;
-            float scale    = min(float(target_w)/input_w, float(target_h)/input_h);
-            int   new_w    = int(input_w * scale);
-            int   new_h    = int(input_h * scale);
-            
-            cv::Mat tar(target_w, target_h, CV_8UC3, cv::Scalar(0, 0, 0));
-            cv::Mat tmp;
-            cv::resize(image, tmp, cv::Size(new_w, new_h));
-
-            int x, y;
-            x = (new_w < target_w) ? (target_w - new_w) / 2 : 0;
-            y = (new_h < target_h) ? (target_h - new_h) / 2 : 0;
-
-            cv::Rect roi(x, y, new_w, new_h);
-
-            cv::Mat roiOfTar = tar(roi);
-            tmp.copyTo(roiOfTar);
-
-            cv::cvtColor(tar, tar, cv::COLOR_BGR2RGB);
-            cv::cvtColor(tar, tar, cv::COLOR_RGB2BGR);
-
-            result.path = changePath(job.src.path, "../results", ".png", "letter_box");
+            result.path = changePath(job.src.path, "../results", encoder::extension(m_writer->options().format), "letter_box");
             result.data = tar;
 
             job.tar->set_value(result);
-            cv::imwrite(result.path, result.data);
+
+            /* 编码和写盘交给writer, 消费者马上去取下一个job; writer积压太多的时候这里会阻塞 */
+            m_writer->write(result.path, result.data);
             LOG(DGREEN"[consumer] Finished processing, save to %s" CLEAR, job.src.path.c_str());
         }
     }
@@ -190,16 +206,21 @@ public:
 private:
     string*            m_imgPaths;
     int                m_batchSize;
-    queue<Job>         m_jobQueue;
-    mutex              m_mtx;
-    condition_variable m_cv;
+    int                m_targetW{800};
+    int                m_targetH{800};
+    unique_ptr<jobqueue::JobQueue<Job>> m_jobQueue;
+    batchio::BatchReader               m_reader;
+    vector<vector<uchar>>              m_buffers;   // 每个batch重复使用的文件内容
+    imgcache::ImageCache               m_cache;
+    unique_ptr<writer::AsyncWriter>     m_writer;
     vector<thread>     m_workers;
     bool               m_running{false};
 };
 
 // RAII模式对实现类进行资源获取即初始化
-std::shared_ptr<Model> create_model (std::string* img_list, int batchSize){
-    shared_ptr<ModelImpl> ins(new ModelImpl(img_list, batchSize));
+std::shared_ptr<Model> create_model (std::string* img_list, int batchSize, jobqueue::QueueType queueType,
+                                     int numWriters, size_t cacheBytes, const encoder::Options& encode){
+    shared_ptr<ModelImpl> ins(new ModelImpl(img_list, batchSize, queueType, numWriters, cacheBytes, encode));
     if (!ins->initialization())
         ins.reset(); //释放shared_ptr所拥有的对象
     return ins;
@@ -0,0 +1,130 @@
+#include <chrono>
+#include <cstdio>
+#include "writer.hpp"
+#include "logger.hpp"
+
+using namespace std;
+
+namespace writer{
+
+static long elapsedUs(chrono::steady_clock::time_point start){
+    return (long)chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+}
+
+AsyncWriter::AsyncWriter(int numThreads, size_t capacity, const encoder::Options& options) :
+    m_options(options),
+    m_queue(new jobqueue::MutexQueue<Task>(capacity > 0 ? capacity : 1))
+{
+    numThreads = numThreads > 0 ? numThreads : 1;
+    for (int i = 0; i < numThreads; i ++){
+        m_threads.emplace_back(&AsyncWriter::run, this, i);
+    }
+}
+
+AsyncWriter::~AsyncWriter(){
+    stop();
+}
+
+bool AsyncWriter::write(const string& path, const cv::Mat& img){
+    {
+        lock_guard<mutex> lock(m_mtx);
+        if (m_stopped) return false;
+        m_pending ++;
+    }
+
+    /* 队列满的时候在这里等, 这部分时间就是消费者被写盘拖住的时间 */
+    auto start = chrono::steady_clock::now();
+    bool ok    = m_queue->push(Task{path, img});
+    m_blockedUs += elapsedUs(start);
+
+    if (!ok){
+        lock_guard<mutex> lock(m_mtx);
+        m_pending --;
+        m_idle.notify_all();
+    }
+    return ok;
+}
+
+void AsyncWriter::flush(){
+    unique_lock<mutex> lock(m_mtx);
+    m_idle.wait(lock, [&](){ return m_pending == 0; });
+}
+
+void AsyncWriter::stop(){
+    {
+        lock_guard<mutex> lock(m_mtx);
+        if (m_stopped) return;
+        m_stopped = true;
+    }
+
+    /* 不再接受新的图片, 已经在队列里的都写完之后writer线程自己退出 */
+    flush();
+    m_queue->close();
+    for (auto& t: m_threads){
+        if (t.joinable()) t.join();
+    }
+}
+
+static bool writeFile(const string& path, const vector<uchar>& bytes){
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f) return false;
+    bool ok = fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size();
+    return (fclose(f) == 0) && ok;
+}
+
+void AsyncWriter::run(int index){
+    Task          task;
+    vector<uchar> bytes;    // 每个writer线程重复使用的编码缓冲
+    while (m_queue->pop(task)){
+        /* 编码和写盘分开计时, 才知道换一种编码能省下多少 */
+        auto start = chrono::steady_clock::now();
+        bool ok    = false;
+        try {
+            ok = encoder::encode(task.img, m_options, bytes);
+        } catch (const cv::Exception& e) {
+            LOGW("[writer%d] %s", index, e.what());
+        }
+        m_encodeUs += elapsedUs(start);
+
+        if (ok){
+            start = chrono::steady_clock::now();
+            ok    = writeFile(task.path, bytes);
+            m_writeUs += elapsedUs(start);
+        }
+        if (ok){
+            m_rawBytes  += (long)(task.img.total() * task.img.elemSize());
+            m_fileBytes += (long)bytes.size();
+        }
+
+        if (ok) m_written ++;
+        else {
+            m_failed ++;
+            LOGW("[writer%d] failed to write %s", index, task.path.c_str());
+        }
+        LOGV(DGREEN"[writer%d] saved %s" CLEAR, index, task.path.c_str());
+
+        /* 先释放图片再通知, flush返回之后结果的内存都已经还回去了 */
+        task.img.release();
+        {
+            lock_guard<mutex> lock(m_mtx);
+            m_pending --;
+        }
+        m_idle.notify_all();
+    }
+}
+
+void AsyncWriter::report() const{
+    long   written   = m_written.load();
+    double encodeSec = m_encodeUs.load() / 1e6;
+    double rawMB     = m_rawBytes.load() / 1048576.0;
+    double fileMB    = m_fileBytes.load() / 1048576.0;
+
+    LOG("[writer] %s: written %ld, failed %ld, encode %.2f ms (%.1f img/s, %.1f MB/s per thread)",
+        encoder::name(m_options.format), written, m_failed.load(), encodeSec * 1000,
+        encodeSec > 0 ? written / encodeSec : 0.0, encodeSec > 0 ? rawMB / encodeSec : 0.0);
+    LOG("[writer] %s: %.2f MB on disk from %.2f MB of pixels (%.1f%%), write %.2f ms, consumers blocked %.2f ms",
+        encoder::name(m_options.format), fileMB, rawMB, rawMB > 0 ? fileMB * 100 / rawMB : 0.0,
+        m_writeUs.load() / 1000.0, m_blockedUs.load() / 1000.0);
+}
+
+} // namespace writer
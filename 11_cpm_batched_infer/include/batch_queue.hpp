@@ -0,0 +1,129 @@
+#ifndef __BATCH_QUEUE_HPP__
+#define __BATCH_QUEUE_HPP__
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace jobqueue{
+
+/* 
+ * 队列满了之后push的行为
+ *  Block:      等到有空位(离线处理, 一帧都不能丢)
+ *  DropOldest: 扔掉队列里最早的那一帧, 再放进新的一帧(实时视频, 总是处理最新的画面)
+ *  DropNewest: 直接扔掉要push的这一帧, 已经在排队的帧不受影响
+ *  丢帧的时候push不会阻塞, 帧在队列里等待的时间最多是capacity帧的处理时间
+ */
+enum class Overload : int {
+    Block      = 0,
+    DropOldest = 1,
+    DropNewest = 2,
+};
+
+/*
+ * reader和生产者之间的帧队列, 生产者从这里按batch取数据(dynamic batching)
+ *  push:      队列满的时候按Overload阻塞或者丢帧, 已经close的时候返回false
+ *  pop_batch: 凑够maxBatch个, 或者队列里最早的那一帧已经等了maxWait, 就把现有的全部取出来
+ *             maxWait为0的时候不设deadline, 只有凑够了或者close了才返回
+ *             close之后剩下不足一个batch的帧也会取出来, 取空了才返回false
+ */
+template <typename T>
+class BatchQueue{
+public:
+    using clock = std::chrono::steady_clock;
+
+    explicit BatchQueue(size_t capacity, Overload overload = Overload::Block) :
+        m_capacity(capacity > 0 ? capacity : 1), m_overload(overload) {}
+
+    bool push(T&& item){
+        /* 被扔掉的帧在锁外面析构, 内存池的回收不占着队列的锁 */
+        T dropped;
+        {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            if (m_overload == Overload::Block)
+                m_notFull.wait(lock, [&](){ return m_closed || m_queue.size() < m_capacity; });
+            if (m_closed) return false;
+
+            if (m_queue.size() >= m_capacity){
+                m_dropped ++;
+                if (m_overload == Overload::DropNewest){
+                    dropped = std::move(item);
+                    return true;
+                }
+                dropped = std::move(m_queue.front().first);
+                m_queue.pop_front();
+            }
+            m_queue.emplace_back(std::move(item), clock::now());
+        }
+        m_notEmpty.notify_one();
+        return true;
+    }
+
+    bool pop_batch(std::vector<T>& items, size_t maxBatch, std::chrono::microseconds maxWait){
+        {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            m_notEmpty.wait(lock, [&](){ return m_closed || !m_queue.empty(); });
+            if (m_queue.empty()) return false;
+
+            /* deadline从这个batch第一帧进入队列的时候开始算, 而不是从pop的时候开始 */
+            auto ready = [&](){ return m_closed || m_queue.size() >= maxBatch || m_queue.size() >= m_capacity; };
+            if (maxWait.count() > 0)
+                m_notEmpty.wait_until(lock, m_queue.front().second + maxWait, ready);
+            else
+                m_notEmpty.wait(lock, ready);
+
+            /* 队列里最早的一帧等了多久, 丢帧的时候这个值不会随着运行时间一直增长 */
+            m_maxLatency = (std::max)(m_maxLatency, std::chrono::duration_cast<std::chrono::microseconds>(
+                                                        clock::now() - m_queue.front().second));
+
+            size_t n = (std::min)(maxBatch, m_queue.size());
+            for (size_t i = 0; i < n; i ++){
+                items.emplace_back(std::move(m_queue.front().first));
+                m_queue.pop_front();
+            }
+        }
+        m_notFull.notify_all();
+        return true;
+    }
+
+    void close(){
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            m_closed = true;
+        }
+        m_notEmpty.notify_all();
+        m_notFull.notify_all();
+    }
+
+    /* 因为队列满而丢掉的帧数 */
+    long dropped() const{
+        std::lock_guard<std::mutex> lock(m_mtx);
+        return m_dropped;
+    }
+
+    /* 被pop_batch取走的帧在队列里等待的最长时间 */
+    std::chrono::microseconds max_latency() const{
+        std::lock_guard<std::mutex> lock(m_mtx);
+        return m_maxLatency;
+    }
+
+private:
+    size_t                  m_capacity;
+    Overload                m_overload;
+    std::deque<std::pair<T, clock::time_point>> m_queue;
+    mutable std::mutex      m_mtx;
+    std::condition_variable m_notEmpty;
+    std::condition_variable m_notFull;
+    bool                    m_closed{false};
+    long                    m_dropped{0};
+    std::chrono::microseconds m_maxLatency{0};
+};
+
+} // namespace jobqueue
+
+#endif //__BATCH_QUEUE_HPP__
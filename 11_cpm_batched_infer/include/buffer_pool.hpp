@@ -0,0 +1,88 @@
+#ifndef __BUFFER_POOL_HPP__
+#define __BUFFER_POOL_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "opencv2/opencv.hpp"
+
+namespace bufferpool{
+
+/*
+ * 可以回收的cv::Mat内存池
+ *  把一个Mat的allocator设置成BufferPool之后, 这个Mat的create就会从池子里拿内存
+ *  Mat的引用计数变成0的时候(比如consumer把结果释放掉了), 内存不会被free, 而是回到池子里
+ *  按照字节数分桶, 同样大小的帧可以一直复用, 连UMatData也一起复用, 稳定之后每帧没有任何堆分配
+ *
+ *  注意: BufferPool必须比所有从它分配出去的Mat活得久
+ */
+class BufferPool : public cv::MatAllocator{
+public:
+    explicit BufferPool(std::string name, size_t maxCachedPerSize = 256);
+    ~BufferPool();
+
+    /* 预先分配count块bytes大小的内存 */
+    void reserve(size_t bytes, int count);
+
+    /* 让mat之后的create都从这个池子里分配 */
+    void attach(cv::Mat& mat) { mat.allocator = this; }
+
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                           cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override;
+    bool allocate(cv::UMatData* u, cv::AccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const override;
+    void deallocate(cv::UMatData* u) const override;
+
+    long allocations() const { return m_allocations.load(); }  // 真正向系统申请内存的次数
+    long requests() const    { return m_requests.load(); }     // 一共被create了多少次
+
+    /* 打印每帧的平均分配次数 */
+    void report(long frames) const;
+
+private:
+    cv::UMatData* acquire(size_t bytes) const;
+
+    std::string                                               m_name;
+    size_t                                                    m_maxCachedPerSize;
+    mutable std::mutex                                        m_mtx;
+    mutable std::unordered_map<size_t, std::vector<cv::UMatData*>> m_free;
+    mutable std::atomic<long>                                 m_allocations{0};
+    mutable std::atomic<long>                                 m_requests{0};
+};
+
+/*
+ * 只用来统计的allocator, 不改变任何分配的行为:
+ *  install之后成为OpenCV的默认allocator, 所有的分配都原样转发给原来的默认allocator,
+ *  分配出去的UMatData也属于原来的allocator, 释放的时候不会再经过这里, uninstall之后也不需要它活着
+ *  setDefaultAllocator是整个进程共享的, 但是只有调用过track_this_thread(true)的线程(model自己的线程)才计数,
+ *  进程里其他线程的分配照常进行, 不计数
+ */
+class CountingAllocator : public cv::MatAllocator{
+public:
+    explicit CountingAllocator(std::string name);
+    ~CountingAllocator();
+
+    void install();
+    void uninstall();
+
+    /* 当前线程的分配要不要计数, 每个线程自己的开关 */
+    static void track_this_thread(bool enable);
+
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                           cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override;
+    bool allocate(cv::UMatData* u, cv::AccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const override;
+    void deallocate(cv::UMatData* u) const override;
+
+    void report(long frames) const;
+
+private:
+    std::string                m_name;
+    cv::MatAllocator*          m_base{nullptr};
+    mutable std::atomic<long>  m_allocations{0};
+};
+
+} // namespace bufferpool
+
+#endif //__BUFFER_POOL_HPP__
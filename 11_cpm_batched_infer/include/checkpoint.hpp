@@ -0,0 +1,77 @@
+#ifndef __CHECKPOINT_HPP__
+#define __CHECKPOINT_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace checkpoint{
+
+/*
+ * 处理图片列表的进度文件, 进程中途被杀掉之后可以从上次完成的位置接着跑:
+ *
+ *  | Header | Record | Record | ... |
+ *
+ *  每处理完一个batch在文件末尾追加一条Record(只追加, 从不改已经写了的内容):
+ *  index是这个batch里最后一张图片在列表里的下标, offset是它在列表文件里的字节位置
+ *  batch是按顺序完成的, 所以index之前的图片都已经处理完了
+ *
+ *  write只进page cache, 每syncEvery条才fdatasync一次; 断电最多重做syncEvery个batch(至少一次的语义)
+ *  最后一条Record写了一半的时候check对不上, 恢复时忽略它, 用前面一条
+ *  Header里记着列表文件的大小和内容的hash(FNV-1a), 列表变了(哪怕大小没变)就不再使用旧的进度
+ *  所有的整数都是小端
+ */
+constexpr char     kMagic[8]  = {'C', 'P', 'M', 'C', 'K', 'P', 'T', '\0'};
+constexpr uint32_t kVersion   = 2;
+constexpr uint64_t kCheckSeed = 0x9E3779B97F4A7C15ull;
+
+struct Header{
+    char     magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t listBytes;     // 列表文件的大小
+    uint64_t listHash;      // 列表文件内容的FNV-1a 64
+};
+
+struct Record{
+    uint64_t index;
+    uint64_t offset;
+    uint64_t check;         // index ^ offset ^ kCheckSeed
+};
+
+class Progress{
+public:
+    explicit Progress(int syncEvery = 16);
+    ~Progress();
+
+    Progress(const Progress&)            = delete;
+    Progress& operator=(const Progress&) = delete;
+
+    /*
+     * 打开(或者新建)进度文件, 之后commit都追加到这个文件里
+     *  有可以用的进度时index/offset是最后一张完成的图片, 否则index为-1
+     *  恢复只读文件最后的几条Record, 和已经完成了多少无关
+     */
+    bool open(const std::string& path, const std::string& listFile, long& index, uint64_t& offset);
+
+    /* 记下一个完成了的batch */
+    void commit(long index, uint64_t offset);
+
+    /* 把还没有落盘的Record都fdatasync掉, 析构的时候也会调用 */
+    void sync();
+
+    long committed() const { return m_commits; }
+
+private:
+    bool create(uint64_t listBytes, uint64_t listHash);
+
+    std::string m_path;
+    int         m_fd{-1};
+    int         m_syncEvery;
+    int         m_unsynced{0};
+    long        m_commits{0};
+};
+
+} // namespace checkpoint
+
+#endif //__CHECKPOINT_HPP__
@@ -0,0 +1,84 @@
+#ifndef __DATA_LIST_HPP__
+#define __DATA_LIST_HPP__
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <string>
+#include <string_view>
+
+namespace datalist{
+
+/*
+ * mmap的列表文件, 每行一个条目(比如图片路径)
+ *  open只做mmap, 不读任何一行, 多大的列表都是瞬间打开, 内存占用只有被访问过的页
+ *  遍历的时候才一行一行地往后找换行符, 每个条目都是指向mmap内存的string_view, 没有拷贝
+ *  行尾的\r会被去掉, 空行会被跳过, 行的长度没有限制
+ *
+ *  注意: string_view只在MappedList活着的时候有效
+ */
+class MappedList{
+public:
+    class iterator{
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type        = std::string_view;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = const std::string_view*;
+        using reference         = const std::string_view&;
+
+        iterator() = default;
+        iterator(const char* pos, const char* end) : m_next(pos), m_end(end) { advance(); }
+
+        reference operator*() const  { return m_line; }
+        pointer   operator->() const { return &m_line; }
+
+        iterator& operator++()   { advance(); return *this; }
+        iterator  operator++(int){ iterator tmp = *this; advance(); return tmp; }
+
+        bool operator==(const iterator& rhs) const { return m_line.data() == rhs.m_line.data(); }
+        bool operator!=(const iterator& rhs) const { return !(*this == rhs); }
+
+    private:
+        void advance();
+
+        const char*      m_next{nullptr};   // 下一行的开头
+        const char*      m_end{nullptr};
+        std::string_view m_line;            // 到结尾之后data()是nullptr, 和end()相等
+    };
+
+    MappedList() = default;
+    explicit MappedList(const std::string& file) { open(file); }
+    ~MappedList();
+
+    MappedList(const MappedList&)            = delete;
+    MappedList& operator=(const MappedList&) = delete;
+
+    /* 打不开的时候返回false, 空文件可以打开, 只是没有条目 */
+    bool open(const std::string& file);
+    void close();
+
+    iterator begin() const { return iterator(m_data, m_data + m_size); }
+    iterator end() const   { return iterator(); }
+
+    /* 从offset字节处开始遍历(offset应该是某一行的开头), 不需要扫描前面的行 */
+    iterator at(size_t offset) const { return iterator(m_data + (std::min)(offset, m_size), m_data + m_size); }
+
+    /* 条目在文件里的字节位置, line必须是这个列表返回的 */
+    size_t   offset_of(std::string_view line) const { return size_t(line.data() - m_data); }
+
+    /* offset是不是某一行的开头 */
+    bool     line_start(size_t offset) const { return offset == 0 || (offset <= m_size && m_data[offset - 1] == '\n'); }
+    bool     empty() const { return begin() == end(); }
+
+    /* 文件的字节数, 不是条目个数(条目个数要遍历一遍才知道) */
+    size_t   bytes() const { return m_size; }
+
+private:
+    const char* m_data{nullptr};
+    size_t      m_size{0};
+};
+
+} // namespace datalist
+
+#endif //__DATA_LIST_HPP__
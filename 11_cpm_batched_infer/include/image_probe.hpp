@@ -0,0 +1,43 @@
+#ifndef __IMAGE_PROBE_HPP__
+#define __IMAGE_PROBE_HPP__
+
+#include <cstddef>
+#include <cstdint>
+
+namespace imgprobe{
+
+enum class Format : int {
+    Unknown = 0,
+    JPEG    = 1,
+    PNG     = 2,
+};
+
+struct Info{
+    Format format{Format::Unknown};
+    int    width{0};
+    int    height{0};
+    int    channels{0};     // 文件里的通道数(灰度1, 彩色3, 带alpha的PNG是2或者4), 不是解码之后的
+};
+
+/*
+ * 只看文件头拿到图片的格式和大小, 不解码
+ *  JPEG: 从SOI开始跳过各个段, 直到SOFn里的宽高和分量个数
+ *  PNG:  签名之后的IHDR里的宽高和颜色类型
+ *  data只需要包含文件开头的一部分, 不认识的格式或者数据不够的时候返回false
+ */
+bool probe(const uint8_t* data, size_t size, Info& info);
+
+/*
+ * 解码之后要letterbox到targetW x targetH的时候, imdecode应该用的flag:
+ *  JPEG可以在libjpeg里直接按1/2, 1/4, 1/8做DCT缩放, 只解码需要的分辨率
+ *  选最大的缩放倍数, 只要缩小之后还不比letterbox之后的大小小, 剩下的交给后面的resize
+ *  其他格式OpenCV是先完整解码再缩小的, 没有好处, 返回cv::IMREAD_COLOR
+ */
+int decode_flag(const Info& info, int targetW, int targetH);
+
+/* 上面两步合起来, 看不懂文件头的时候返回cv::IMREAD_COLOR */
+int decode_flag(const uint8_t* data, size_t size, int targetW, int targetH);
+
+} // namespace imgprobe
+
+#endif //__IMAGE_PROBE_HPP__
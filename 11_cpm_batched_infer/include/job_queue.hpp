@@ -0,0 +1,468 @@
+#ifndef __JOB_QUEUE_HPP__
+#define __JOB_QUEUE_HPP__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace jobqueue{
+
+// 大部分x86/arm的cache line都是64字节
+constexpr size_t kCacheLine = 64;
+
+/*
+ * RingQueue和StealQueue里有按cache line对齐的成员, c++14的new不保证超过16字节的对齐,
+ * 继承这个类之后, 队列对象本身也用posix_memalign按cache line分配, 和环形数组的cell一样
+ */
+struct CacheAligned{
+    static void* operator new(size_t size){
+        void* raw = nullptr;
+        if (posix_memalign(&raw, kCacheLine, size) != 0)
+            throw std::bad_alloc();
+        return raw;
+    }
+    static void operator delete(void* p){
+        free(p);
+    }
+};
+
+enum class QueueType : int {
+    Mutex = 0,   // std::queue + mutex + condition_variable
+    Ring  = 1,   // 定长的lock-free MPMC环形队列
+    Steal = 2,   // work-stealing: 每个消费者有自己的deque, 空闲的消费者从别人的deque尾部偷job
+};
+
+/*
+ * 生产者和消费者之间的job队列
+ *  push: 队列满的时候阻塞, 队列已经close的时候返回false
+ *  pop:  队列空的时候阻塞, 队列已经close并且没有数据的时候返回false
+ */
+template <typename T>
+class JobQueue{
+public:
+    virtual ~JobQueue() {}
+    virtual bool push(T&& item) = 0;
+    virtual bool pop(T& item) = 0;
+    virtual void close() = 0;
+
+    /* 带消费者编号的pop, 只有work-stealing需要知道是哪个消费者在取job */
+    virtual bool pop(int worker, T& item){
+        return pop(item);
+    }
+
+    /* 一次push一批数据, 默认就是逐个push */
+    virtual bool push_bulk(std::vector<T>& items){
+        for (auto& item: items){
+            if (!push(std::move(item))) return false;
+        }
+        return true;
+    }
+};
+
+/*
+ * 原来ModelImpl里面的实现: 所有的push和pop都要抢同一把锁
+ *  capacity为0的时候不限制长度
+ */
+template <typename T>
+class MutexQueue : public JobQueue<T>{
+public:
+    explicit MutexQueue(size_t capacity = 0) : m_capacity(capacity) {}
+
+    bool push(T&& item) override{
+        {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            m_notFull.wait(lock, [&](){ return m_closed || !full(); });
+            if (m_closed) return false;
+            m_queue.emplace(std::move(item));
+        }
+        m_notEmpty.notify_one();
+        return true;
+    }
+
+    /* 一把锁push完一整个batch, 之后唤醒所有的消费者 */
+    bool push_bulk(std::vector<T>& items) override{
+        if (m_capacity != 0) return JobQueue<T>::push_bulk(items);
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            if (m_closed) return false;
+            for (auto& item: items){
+                m_queue.emplace(std::move(item));
+            }
+        }
+        m_notEmpty.notify_all();
+        return true;
+    }
+
+    bool pop(T& item) override{
+        {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            m_notEmpty.wait(lock, [&](){ return m_closed || !m_queue.empty(); });
+            if (m_queue.empty()) return false;
+            item = std::move(m_queue.front());
+            m_queue.pop();
+        }
+        if (m_capacity != 0) m_notFull.notify_one();
+        return true;
+    }
+
+    void close() override{
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            m_closed = true;
+        }
+        m_notEmpty.notify_all();
+        m_notFull.notify_all();
+    }
+
+private:
+    bool full() const { return m_capacity != 0 && m_queue.size() >= m_capacity; }
+
+    size_t                  m_capacity;
+    std::queue<T>           m_queue;
+    std::mutex              m_mtx;
+    std::condition_variable m_notEmpty;
+    std::condition_variable m_notFull;
+    bool                    m_closed{false};
+};
+
+/*
+ * 定长的lock-free多生产者多消费者环形队列(Dmitry Vyukov的bounded MPMC queue)
+ *  每一个cell带一个序号seq:
+ *    seq == pos       这个cell是空的, 可以被第pos个push写入
+ *    seq == pos + 1   这个cell已经写好了, 可以被第pos个pop读出
+ *  push和pop只在各自的位置计数器上做CAS, 互相之间不抢锁
+ *  cell和两个计数器都按cache line对齐, 避免不同线程之间的false sharing
+ *
+ *  只有在队列真的空了(或者满了)的时候才会去睡眠:
+ *  先自旋一小会儿, 之后在mutex + condition_variable上等待, 对端只有在有人睡眠时才会去拿锁唤醒
+ */
+template <typename T>
+class RingQueue : public JobQueue<T>, public CacheAligned{
+public:
+    explicit RingQueue(size_t capacity){
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        m_mask  = size - 1;
+
+        /* c++14的new不保证按cache line对齐, 这里手动分配对齐的内存 */
+        void* raw = nullptr;
+        if (posix_memalign(&raw, kCacheLine, sizeof(Cell) * size) != 0)
+            throw std::bad_alloc();
+        m_cells = static_cast<Cell*>(raw);
+        for (size_t i = 0; i < size; i ++){
+            new (&m_cells[i]) Cell();
+            m_cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~RingQueue(){
+        for (size_t i = 0; i <= m_mask; i ++){
+            m_cells[i].~Cell();
+        }
+        free(m_cells);
+    }
+
+    RingQueue(const RingQueue&) = delete;
+    RingQueue& operator=(const RingQueue&) = delete;
+
+    bool try_push(T&& item){
+        Cell*  cell;
+        size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+        while (true){
+            cell = &m_cells[pos & m_mask];
+            size_t   seq  = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0){
+                if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0){
+                return false;  // 满了
+            } else {
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = std::move(item);
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T& item){
+        Cell*  cell;
+        size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+        while (true){
+            cell = &m_cells[pos & m_mask];
+            size_t   seq  = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0){
+                if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0){
+                return false;  // 空了
+            } else {
+                pos = m_dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+        item = std::move(cell->data);
+        cell->seq.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool push(T&& item) override{
+        if (m_closed.load(std::memory_order_acquire)) return false;
+        if (!try_push(std::move(item))){
+            if (!wait(m_pushWaiters, m_notFull, [&](){ return try_push(std::move(item)); }))
+                return false;
+        }
+        wake(m_popWaiters, m_notEmpty, false);
+        return true;
+    }
+
+    bool push_bulk(std::vector<T>& items) override{
+        if (m_closed.load(std::memory_order_acquire)) return false;
+        for (auto& item: items){
+            if (!try_push(std::move(item))){
+                /* 环满了, 先把已经放进去的叫醒, 再等空位 */
+                wake(m_popWaiters, m_notEmpty, true);
+                if (!wait(m_pushWaiters, m_notFull, [&](){ return try_push(std::move(item)); }))
+                    return false;
+            }
+        }
+        wake(m_popWaiters, m_notEmpty, true);
+        return true;
+    }
+
+    bool pop(T& item) override{
+        if (!try_pop(item)){
+            if (!wait(m_popWaiters, m_notEmpty, [&](){ return try_pop(item); }))
+                return false;
+        }
+        wake(m_pushWaiters, m_notFull, false);
+        return true;
+    }
+
+    void close() override{
+        m_closed.store(true, std::memory_order_release);
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_notEmpty.notify_all();
+        m_notFull.notify_all();
+    }
+
+private:
+    struct alignas(kCacheLine) Cell{
+        std::atomic<size_t> seq;
+        T                   data;
+    };
+
+    /*
+     * 慢路径: 先自旋, 还不行就登记为waiter之后睡眠
+     *  waiter计数和对端的push/pop之间用seq_cst fence保证:
+     *  要么这里的attempt能看到对端的数据, 要么对端能看到这里登记的waiter
+     */
+    template <typename Attempt>
+    bool wait(std::atomic<int>& waiters, std::condition_variable& cv, Attempt attempt){
+        for (int i = 0; i < kSpin; i ++){
+            if (attempt()) return true;
+            if (m_closed.load(std::memory_order_acquire)) return attempt();
+            std::this_thread::yield();
+        }
+
+        std::unique_lock<std::mutex> lock(m_mtx);
+        waiters.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool ok;
+        while (true){
+            if ((ok = attempt())) break;
+            if (m_closed.load(std::memory_order_acquire)) { ok = attempt(); break; }
+            cv.wait(lock);
+        }
+        waiters.fetch_sub(1, std::memory_order_relaxed);
+        return ok;
+    }
+
+    void wake(std::atomic<int>& waiters, std::condition_variable& cv, bool all){
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters.load(std::memory_order_relaxed) == 0) return;
+        std::lock_guard<std::mutex> lock(m_mtx);
+        if (all) cv.notify_all();
+        else     cv.notify_one();
+    }
+
+    static constexpr int kSpin = 64;
+
+    Cell*                               m_cells;
+    size_t                              m_mask;
+    alignas(kCacheLine) std::atomic<size_t> m_enqueuePos{0};
+    alignas(kCacheLine) std::atomic<size_t> m_dequeuePos{0};
+    alignas(kCacheLine) std::atomic<int>    m_popWaiters{0};
+    std::atomic<int>                    m_pushWaiters{0};
+    std::atomic<bool>                   m_closed{false};
+    std::mutex                          m_mtx;
+    std::condition_variable             m_notEmpty;
+    std::condition_variable             m_notFull;
+};
+
+/*
+ * work-stealing调度:
+ *  每个消费者有一个自己的deque, 生产者把一个batch的job轮流分到各个deque里
+ *  消费者优先从自己deque的头部取job, 自己的取完了就去别人deque的尾部偷
+ *  这样大部分时候每个消费者只碰自己的那把锁, job耗时不均匀(比如图片大小不一样)的时候也不会有人闲着
+ *  所有deque都空了才会在condition_variable上睡眠
+ */
+template <typename T>
+class StealQueue : public JobQueue<T>, public CacheAligned{
+public:
+    explicit StealQueue(int numWorkers) :
+        m_numDeques(numWorkers > 0 ? numWorkers : 1), m_deques(new Deque[m_numDeques]) {}
+
+    bool push(T&& item) override{
+        if (m_closed.load(std::memory_order_acquire)) return false;
+        Deque& d = m_deques[m_next.fetch_add(1, std::memory_order_relaxed) % m_numDeques];
+        {
+            std::lock_guard<std::mutex> lock(d.mtx);
+            d.jobs.emplace_back(std::move(item));
+        }
+        m_size.fetch_add(1, std::memory_order_seq_cst);
+        wake(false);
+        return true;
+    }
+
+    /* 同一个batch里相邻的job分给不同的消费者 */
+    bool push_bulk(std::vector<T>& items) override{
+        if (m_closed.load(std::memory_order_acquire)) return false;
+        size_t start = m_next.fetch_add(items.size(), std::memory_order_relaxed);
+        for (int k = 0; k < m_numDeques; k ++){
+            Deque& d = m_deques[(start + k) % m_numDeques];
+            std::lock_guard<std::mutex> lock(d.mtx);
+            for (size_t i = k; i < items.size(); i += m_numDeques){
+                d.jobs.emplace_back(std::move(items[i]));
+            }
+        }
+        m_size.fetch_add(items.size(), std::memory_order_seq_cst);
+        wake(true);
+        return true;
+    }
+
+    bool pop(T& item) override{
+        static std::atomic<int> s_next{0};
+        thread_local int worker = s_next.fetch_add(1, std::memory_order_relaxed);
+        return pop(worker, item);
+    }
+
+    bool pop(int worker, T& item) override{
+        worker %= m_numDeques;
+        for (int i = 0; i < kSpin; i ++){
+            if (take(worker, item)) return true;
+            if (m_closed.load(std::memory_order_acquire)) return take(worker, item);
+            std::this_thread::yield();
+        }
+
+        std::unique_lock<std::mutex> lock(m_mtx);
+        m_sleepers.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool ok;
+        while (true){
+            /* 这里偷的时候要等到拿到锁为止, try_to_lock失败时m_size还大于0, 下面的wait会立刻返回, 拿着m_mtx空转 */
+            if ((ok = take(worker, item, true))) break;
+            if (m_closed.load(std::memory_order_acquire)) { ok = take(worker, item, true); break; }
+            /* 有job但是被别人抢先拿走了的话, 继续睡 */
+            m_notEmpty.wait(lock, [&](){
+                return m_closed.load(std::memory_order_acquire) || m_size.load(std::memory_order_seq_cst) > 0;
+            });
+        }
+        m_sleepers.fetch_sub(1, std::memory_order_relaxed);
+        return ok;
+    }
+
+    void close() override{
+        m_closed.store(true, std::memory_order_release);
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_notEmpty.notify_all();
+    }
+
+private:
+    /* 每个deque后面补一个cache line, 相邻两个消费者的锁不会落在同一个cache line上 */
+    struct Deque{
+        std::mutex    mtx;
+        std::deque<T> jobs;
+        char          pad[kCacheLine];
+    };
+
+    /*
+     * blocking为false时偷的时候只try_lock, 抢不到就换下一个deque
+     * 持有m_mtx的时候要用blocking, 加锁的顺序总是m_mtx -> deque.mtx, push不会同时拿着这两把锁
+     */
+    bool take(int worker, T& item, bool blocking = false){
+        if (m_size.load(std::memory_order_seq_cst) == 0) return false;
+
+        /* 先取自己的deque头部 */
+        {
+            Deque& own = m_deques[worker];
+            std::lock_guard<std::mutex> lock(own.mtx);
+            if (!own.jobs.empty()){
+                item = std::move(own.jobs.front());
+                own.jobs.pop_front();
+                m_size.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+
+        /* 再从其他消费者的deque尾部偷, 从旁边的消费者开始找 */
+        for (int k = 1; k < m_numDeques; k ++){
+            Deque& victim = m_deques[(worker + k) % m_numDeques];
+            std::unique_lock<std::mutex> lock(victim.mtx, std::defer_lock);
+            if (blocking) lock.lock();
+            else if (!lock.try_lock()) continue;
+            if (victim.jobs.empty()) continue;
+            item = std::move(victim.jobs.back());
+            victim.jobs.pop_back();
+            m_size.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    void wake(bool all){
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_sleepers.load(std::memory_order_relaxed) == 0) return;
+        std::lock_guard<std::mutex> lock(m_mtx);
+        if (all) m_notEmpty.notify_all();
+        else     m_notEmpty.notify_one();
+    }
+
+    static constexpr int kSpin = 64;
+
+    int                         m_numDeques;
+    std::unique_ptr<Deque[]>    m_deques;
+    alignas(kCacheLine) std::atomic<size_t> m_next{0};
+    alignas(kCacheLine) std::atomic<long>   m_size{0};
+    std::atomic<int>            m_sleepers{0};
+    std::atomic<bool>           m_closed{false};
+    std::mutex                  m_mtx;
+    std::condition_variable     m_notEmpty;
+};
+
+/*
+ * capacity:   RingQueue的容量
+ * numWorkers: StealQueue里deque的个数, 也就是消费者的个数
+ */
+template <typename T>
+std::unique_ptr<JobQueue<T>> create_queue(QueueType type, size_t capacity, int numWorkers = 1){
+    if (type == QueueType::Ring)
+        return std::unique_ptr<JobQueue<T>>(new RingQueue<T>(capacity));
+    if (type == QueueType::Steal)
+        return std::unique_ptr<JobQueue<T>>(new StealQueue<T>(numWorkers));
+    return std::unique_ptr<JobQueue<T>>(new MutexQueue<T>());
+}
+
+} // namespace jobqueue
+
+#endif //__JOB_QUEUE_HPP__
@@ -29,6 +29,11 @@ namespace logger {
         Fatal    = 0,
     };
     void set_log_level(LogLevel level);
+
+    // 日志由后台线程异步地写出去, flush等到调用之前的日志都写到stdout为止
+    void flush();
+    // 因为线程自己的队列满了而丢掉的日志条数
+    long dropped();
     void __make_log(const char* file, int line, LogLevel level, const char* format, ...);
 }; // namespace logger
 
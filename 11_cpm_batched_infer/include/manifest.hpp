@@ -0,0 +1,82 @@
+#ifndef __MANIFEST_HPP__
+#define __MANIFEST_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace manifest{
+
+/*
+ * 图片列表的索引(manifest): 每张图片的路径, 宽高, 通道数和文件大小, 解码之前就能知道
+ *
+ *  | Header | Record[count] | 路径(不以0结尾, 一个接一个) |
+ *
+ *  Record是定长的, 第i张图片直接是records[i], 路径由Record里的offset和length指向后面的字符串区
+ *  宽高和通道数是只解析JPEG/PNG文件头得到的, 解析不了的图片(其他格式, 文件不存在)都是0, 但仍然占一条,
+ *  这样第i条总是列表里的第i行
+ *  所有的整数都是小端
+ */
+constexpr char     kMagic[8] = {'C', 'P', 'M', 'M', 'A', 'N', 'I', '\0'};
+constexpr uint32_t kVersion  = 1;
+
+struct Header{
+    char     magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t count;          // 图片的个数
+    uint64_t stringsOffset;  // 路径字符串区在文件里的位置
+    uint64_t stringsBytes;
+};
+
+struct Record{
+    uint64_t pathOffset;     // 相对于字符串区的开头
+    uint32_t pathLength;
+    uint32_t width;
+    uint32_t height;
+    uint8_t  channels;
+    uint8_t  format;         // imgprobe::Format
+    uint16_t reserved;
+    uint64_t fileBytes;      // 文件大小, 打不开的时候是0
+};
+
+/*
+ * 扫描一个列表文件(每行一个路径), 用numThreads个线程并行地只读每个文件的开头解析文件头,
+ * 写成上面的格式, 成功的时候返回true
+ */
+bool build(const std::string& listFile, const std::string& output, int numThreads);
+
+/* 文件开头是不是manifest的magic */
+bool is_manifest(const std::string& path);
+
+/*
+ * mmap一个manifest, 打开的时候只检查Header和大小, 不读任何一条记录, 多大的索引都是瞬间打开
+ *  注意: path返回的string_view只在Index活着的时候有效
+ */
+class Index{
+public:
+    Index() = default;
+    ~Index();
+
+    Index(const Index&)            = delete;
+    Index& operator=(const Index&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    size_t           size() const { return m_count; }
+    const Record&    operator[](size_t i) const { return m_records[i]; }
+    std::string_view path(size_t i) const;
+
+private:
+    const uint8_t* m_data{nullptr};
+    size_t         m_bytes{0};
+    const Record*  m_records{nullptr};
+    const char*    m_strings{nullptr};
+    size_t         m_count{0};
+};
+
+} // namespace manifest
+
+#endif //__MANIFEST_HPP__
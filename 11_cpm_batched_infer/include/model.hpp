@@ -6,13 +6,157 @@
 #include <future>
 #include <vector>
 #include <string>
+#include <functional>
 #include "opencv2/opencv.hpp"
+#include "job_queue.hpp"
+#include "source.hpp"
+#include "batch_queue.hpp"
 
 namespace model{
 
+// data从model的output内存池分配(见Options::pooledBuffers), 回调之外留着的img必须在model析构之前释放
 struct img{
     cv::Mat data;
     std::string path;
+    int  stream{0};     // 来自哪一路输入, 见Options::streams
+    long frame{0};      // 在这一路输入里的帧编号
+};
+
+// 连续的batch tensor, 内存属于model, 只在onBatch回调期间有效
+struct tensor{
+    float* data{nullptr};
+    int n{0};
+    int c{3};
+    int h{0};
+    int w{0};
+};
+
+// 一个batch处理完之后的结果
+//   Layout::Image 时images[i].data是每一帧的HWC结果, input为空
+//   Layout::NCHW  时images[i].data为空, 第i帧在input.data + i * c * h * w
+struct batch{
+    std::vector<img> images;
+    tensor input;
+};
+
+// 消费者输出结果的格式
+//   Image: 每一帧一个800x800 HWC的cv::Mat(BGR, uint8)
+//   NCHW:  每个batch一块连续的[N, 3, H, W] float(RGB, 0~255), 消费者直接写自己的那一片
+enum class Layout{
+    Image = 0,
+    NCHW  = 1
+};
+
+struct Options{
+    // 流水线深度: 同时存在的batch缓冲个数
+    //   1: lock-step, 解码完一个batch -> 处理 -> 同步, 之后再解码下一个batch
+    //   2: double buffer, 在处理第N个batch的同时解码第N+1个batch
+    int pipelineDepth = 2;
+
+    // dynamic batching的deadline(ms): 一个batch的第一帧等待超过maxWaitMs时, 不再等凑够batchSize, 直接发出去
+    //   0: 不设deadline, 只有凑够batchSize或者视频结束的时候才发出(视频结束时不足一个batch的帧也会处理)
+    double maxWaitMs  = 0;
+
+    // reader解码的速度超过消费者的时候, 帧队列满了怎么办(见jobqueue::Overload)
+    //   Block:      reader等待, 一帧都不丢(离线处理视频或者图片)
+    //   DropOldest: 扔掉排队最久的帧, 实时的摄像头画面延迟不会越积越多
+    //   DropNewest: 扔掉刚解码出来的帧
+    // 只有pipelineDepth >= 2时才有单独的reader和帧队列, 不是Block的时候pipelineDepth至少会是2
+    // DropOldest/DropNewest只对视频和streams有效, 图片列表和shard总是Block(会打印warning)
+    jobqueue::Overload overload = jobqueue::Overload::Block;
+
+    // forward的输入
+    //   Video:     videoPath指定的视频
+    //   ImageList: listPath指定的列表文件, 每行一个图片路径
+    //   Shard:     shardPath指定的预先解码好的帧(tools/pack_shard打包), 不需要解码
+    source::SourceType sourceType = source::SourceType::Video;
+
+    // 输入的视频
+    std::string videoPath = "/home/phoenix/workstation/multi-thread-programming/11_cpm_batched_infer/mot_people_medium.mp4";
+
+    // 输入的图片列表
+    std::string listPath  = "/home/phoenix/workstation/multi-thread-programming/11_cpm_batched_infer/data/BDD100K_list.txt";
+
+    // 预先解码好的帧
+    std::string shardPath = "/home/phoenix/workstation/multi-thread-programming/11_cpm_batched_infer/data/mot_people_medium.shard";
+
+    // 多路视频(文件或者摄像头的url), 不为空的时候代替上面的输入
+    //   每一路一个reader线程, 解码好的帧进同一个帧队列, batch由当时已经解码好的帧组成, 不管来自哪一路
+    //   所有的输入共用同一组消费者, 某一路慢了batch也能被其他路填满
+    //   结果里的img::stream是输入在streams里的下标, img::frame是这一路里的帧编号
+    std::vector<std::string> streams;
+
+    // 解码线程个数
+    //   视频:  1是一个cv::VideoCapture顺序解码
+    //          >1时把视频切成segmentFrames帧一段, 每个解码线程用自己的VideoCapture解码不同的段, 再按顺序拼起来
+    //   图片:  同时读文件 + imdecode的线程个数
+    //   0:     使用std::thread::hardware_concurrency()
+    int numDecoders   = 1;
+
+    // 视频每隔多少帧取一帧(比如30fps的视频只需要5fps的时候是6), 跳过的帧只grab不retrieve
+    // 结束时同时打印视频本身的帧率和实际处理的帧率; 图片列表和shard不受影响
+    int frameStride   = 1;
+
+    // 分段解码时每一段的帧数, 最好是视频GOP的好几倍(seek要从前一个关键帧开始解码)
+    // 最多同时有numDecoders * segmentFrames帧在内存里
+    int segmentFrames = 250;
+
+    // 图片列表的进度文件, 为空时不做checkpoint
+    //   每处理完一个batch追加一条记录, 每checkpointSyncBatches个batch才fdatasync一次
+    //   重新运行时从上次处理完的位置接着跑, 被杀掉的时候最多重做checkpointSyncBatches个batch; 想从头跑就删掉这个文件
+    //   只对单路的图片列表有效
+    std::string checkpointPath;
+    int checkpointSyncBatches = 16;
+
+    // 图片列表最多提前解码多少张, 解码线程最多领先reader这么多张
+    int prefetch      = 64;
+
+    // 图片列表解码之后的LRU缓存大小(字节), 列表里重复出现的图片不再读文件和解码
+    // 缓存由model持有, 0表示不缓存
+    size_t cacheBytes = 0;
+
+    // letterbox之后的大小
+    int targetW       = 800;
+    int targetH       = 800;
+
+    // 图片列表里比letterbox之后的大小大很多的JPEG, 直接在解码的时候按1/2, 1/4, 1/8缩小
+    // 缩小之后仍然不比letterbox之后的小, 剩下的交给letterbox; 视频和shard不受影响
+    bool reducedDecode = true;
+
+    // 消费者线程个数, 与batchSize无关
+    //   0: 使用std::thread::hardware_concurrency()
+    int numWorkers    = 0;
+
+    // 生产者和消费者之间的job队列(调度方式)
+    //   Mutex: std::queue + mutex + condition_variable
+    //   Ring:  lock-free MPMC环形队列, 只有在空/满的时候才会阻塞
+    //   Steal: work-stealing, 每个消费者一个deque, 空闲时从别人那里偷job
+    jobqueue::QueueType queueType = jobqueue::QueueType::Ring;
+
+    // 消费者里letterbox的实现
+    //   true:  融合的单次写入实现(SIMD, 运行时选择指令集)
+    //   false: 原来的OpenCV实现, resize + copyTo + cvtColor
+    bool fusedPreprocess = true;
+
+    // 对每一帧都和OpenCV的实现做一次逐字节比较, 不一致的时候打印warning, 只用来验证
+    bool checkPreprocess = false;
+
+    // 解码出来的帧和letterbox的结果都从可回收的内存池里分配, consumer释放结果之后内存回到池子里
+    bool pooledBuffers   = true;
+
+    // 统计forward期间所有其他cv::Mat(比如OpenCV内部的临时变量)的分配次数, 只用来对比
+    // 会临时替换进程全局的默认allocator(只转发, 不改变分配行为), 只统计model自己的线程
+    bool countAllocations = false;
+
+    // 输出的格式, 见Layout
+    Layout layout = Layout::Image;
+
+    // 每个batch处理完之后在生产者线程里回调, 可以在这里把tensor交给网络
+    std::function<void(const batch&)> onBatch;
+
+    // onBatch之后对batch里的每一帧回调一次, 按img::stream分发给各路输入自己的后处理
+    // 同一路的帧总是按顺序回调的
+    std::function<void(const img&)> onFrame;
 };
 
 class Model{
@@ -21,7 +165,7 @@ public:
     virtual void forward() = 0;
 };
 
-std::shared_ptr<Model> create_model (int batchSize);
+std::shared_ptr<Model> create_model (int batchSize, const Options& options = Options());
     
 }// namespace model
 #endif __MODEL_HPP__
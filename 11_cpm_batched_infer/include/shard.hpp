@@ -0,0 +1,98 @@
+#ifndef __SHARD_HPP__
+#define __SHARD_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "opencv2/opencv.hpp"
+
+namespace shard{
+
+/*
+ * 预先解码好的帧打包成的一个文件(shard), 用来把解码和流水线本身的开销分开测:
+ *
+ *  | Header | pad | frame 0 | pad | frame 1 | pad | ... | Entry[count] |
+ *
+ *  Header在文件开头, 每一帧的像素按kAlignment对齐, 一帧内部的行是连续的(step == cols * elemSize)
+ *  Entry的索引放在文件最后, 写的时候不需要事先知道有多少帧, 写完之后再回头补上Header
+ *  所有的整数都是小端
+ */
+constexpr char     kMagic[8]  = {'C', 'P', 'M', 'S', 'H', 'R', 'D', '\0'};
+constexpr uint32_t kVersion   = 1;
+constexpr uint64_t kAlignment = 4096;
+
+struct Header{
+    char     magic[8];
+    uint32_t version;
+    uint32_t count;        // 帧的个数
+    uint64_t indexOffset;  // Entry[count]在文件里的位置
+    uint64_t alignment;
+};
+
+struct Entry{
+    uint64_t offset;       // 像素在文件里的位置, 按alignment对齐
+    uint32_t rows;
+    uint32_t cols;
+    int32_t  type;         // cv::Mat::type(), 一般是CV_8UC3
+    uint32_t reserved;
+};
+
+/* 一帧一帧地往shard里追加 */
+class Writer{
+public:
+    Writer() = default;
+    ~Writer();
+
+    Writer(const Writer&)            = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    bool open(const std::string& path);
+    bool add(const cv::Mat& frame);
+
+    /* 写索引, 补上Header, 之后shard才是完整的 */
+    bool finish();
+
+    size_t count() const { return m_entries.size(); }
+
+private:
+    bool pad(uint64_t alignment);
+
+    FILE*              m_file{nullptr};
+    uint64_t           m_offset{0};
+    std::vector<Entry> m_entries;
+};
+
+/*
+ * mmap一个shard, frame(i)返回的cv::Mat直接指向mmap的内存, 没有拷贝
+ *  mmap是MAP_PRIVATE的, 万一有人写了返回的Mat也只会写到自己的副本里, 不会改到文件
+ *  注意: 返回的Mat不能比Reader活得久
+ */
+class Reader{
+public:
+    Reader() = default;
+    ~Reader();
+
+    Reader(const Reader&)            = delete;
+    Reader& operator=(const Reader&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    size_t  size() const { return m_count; }
+    cv::Mat frame(size_t i) const;
+
+    /* 提示内核提前把第i帧读进page cache */
+    void    prefetch(size_t i) const;
+
+private:
+    uint8_t*     m_data{nullptr};
+    size_t       m_bytes{0};
+    const Entry* m_index{nullptr};
+    size_t       m_count{0};
+};
+
+} // namespace shard
+
+#endif //__SHARD_HPP__
@@ -0,0 +1,91 @@
+#ifndef __SOURCE_HPP__
+#define __SOURCE_HPP__
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "opencv2/opencv.hpp"
+#include "image_cache.hpp"
+
+namespace source{
+
+enum class SourceType : int {
+    Video     = 0,   // 一个视频文件
+    ImageList = 1,   // 一个图片路径的列表文件, 每行一个路径
+    Shard     = 2,   // tools/pack_shard打包好的已经解码的帧
+};
+
+// 一帧在输入里的位置: 第几个条目, 以及这个条目在列表文件里的字节位置
+struct Position{
+    long     index{-1};
+    uint64_t offset{0};
+};
+
+/*
+ * forward的输入: 按顺序一帧一帧地给出解码好的BGR图片
+ *  read:  取下一帧, 已经没有帧了返回false, 只会被一个reader线程调用
+ *  close: 提前结束, 内部的解码线程都会退出, 之后read返回false
+ *
+ *  创建的时候可以传入一个allocator(比如BufferPool), 解码出来的帧都从这个allocator分配
+ */
+class Source{
+public:
+    virtual ~Source() {}
+    virtual bool read(cv::Mat& frame) = 0;
+    virtual void close() {}
+
+    /* 视频里一共走过了多少帧(包括stride跳过的), 用来算输入本身的帧率; 不是视频的source返回-1 */
+    virtual long source_frames() const { return -1; }
+
+    /* 最近一次read返回的帧在输入里的位置, 用来做checkpoint; 只有图片列表支持 */
+    virtual bool position(Position& pos) const { (void)pos; return false; }
+};
+
+/*
+ * 视频:
+ *  numDecoders <= 1 时就是一个cv::VideoCapture顺序解码
+ *  numDecoders >  1 时把视频切成segmentFrames帧一段, 按段轮流分给numDecoders个解码线程,
+ *  每个线程有自己的VideoCapture, seek到段的开头开始解码, read再按原来的顺序把各段拼起来
+ *
+ *  OpenCV拿不到关键帧的位置, seek会从前一个关键帧开始解码到段的开头, 所以segmentFrames最好是GOP的好几倍
+ *  seek之后用上一帧的时间戳和帧率独立地确认位置, 停在前面的时候往后grab补齐;
+ *  确认不了的时候整个source退回顺序解码(最多从头多解码一遍), 保证段的边界上不重复也不丢帧
+ *  每个解码线程最多缓存一段, 所以最多同时有numDecoders * segmentFrames帧在内存里
+ *
+ *  stride > 1 时只保留帧号是stride倍数的帧(比如30fps的视频只要5fps):
+ *  跳过的帧只grab(解复用 + 解码), 不retrieve, 省掉了颜色转换和拷贝到Mat的开销
+ *  打不开的时候返回nullptr
+ */
+std::unique_ptr<Source> create_video_source(const std::string& path, int numDecoders, int segmentFrames,
+                                            cv::MatAllocator* allocator = nullptr, int stride = 1);
+
+/*
+ * 图片列表:
+ *  numDecoders个解码线程按列表的顺序各自认领下一张图片, 读文件 + imdecode, 解码结果放进一个prefetch大小的窗口里
+ *  read严格按列表的顺序从窗口里取, 解码线程最多只能领先read prefetch张, 内存有上限
+ *  读不了或者解码失败的图片会打印warning并跳过
+ *  listFile也可以是tools/build_manifest生成的manifest(见manifest.hpp), 这时候宽高直接从索引里拿, 不需要再看文件头
+ *  给了cache的时候先按路径查缓存, 命中就不读文件也不解码, 解码出来的帧放进缓存(cache要比source活得久)
+ *  给了reduceTo(之后要letterbox到的大小)的时候, 比它大很多的JPEG直接按1/2, 1/4, 1/8解码(见image_probe.hpp),
+ *  出来的帧不一定是原图的大小, 但总是不比letterbox之后的小
+ *  resumeAfter是上一次已经处理完的最后一个条目(checkpoint里记的), 从它的下一个条目开始,
+ *  文本列表直接跳到记下的字节位置, 不扫描前面的行
+ *  列表为空或者打不开的时候返回nullptr
+ */
+std::unique_ptr<Source> create_list_source(const std::string& listFile, int numDecoders, int prefetch,
+                                           cv::MatAllocator* allocator = nullptr,
+                                           imgcache::ImageCache* cache = nullptr,
+                                           cv::Size reduceTo = cv::Size(),
+                                           const Position& resumeAfter = Position());
+
+/*
+ * 预先解码好的shard(见shard.hpp):
+ *  整个文件mmap进来, read返回的帧直接指向mmap的内存, 没有解码也没有拷贝
+ *  返回的帧不能比source活得久
+ */
+std::unique_ptr<Source> create_shard_source(const std::string& path);
+
+} // namespace source
+
+#endif //__SOURCE_HPP__
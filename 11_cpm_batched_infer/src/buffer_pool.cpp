@@ -0,0 +1,166 @@
+#include "buffer_pool.hpp"
+#include "logger.hpp"
+
+using namespace std;
+
+namespace bufferpool{
+
+BufferPool::BufferPool(string name, size_t maxCachedPerSize):
+    m_name(name), m_maxCachedPerSize(maxCachedPerSize) {}
+
+BufferPool::~BufferPool(){
+    for (auto& bucket: m_free){
+        for (auto u: bucket.second){
+            cv::fastFree(u->origdata);
+            u->origdata = 0;
+            delete u;
+        }
+    }
+}
+
+void BufferPool::reserve(size_t bytes, int count){
+    vector<cv::UMatData*> blocks;
+    for (int i = 0; i < count; i ++){
+        blocks.push_back(acquire(bytes));
+    }
+    for (auto u: blocks){
+        deallocate(u);
+    }
+}
+
+cv::UMatData* BufferPool::acquire(size_t bytes) const{
+    {
+        lock_guard<mutex> lock(m_mtx);
+        auto it = m_free.find(bytes);
+        if (it != m_free.end() && !it->second.empty()){
+            cv::UMatData* u = it->second.back();
+            it->second.pop_back();
+            u->data = u->origdata;
+            return u;
+        }
+    }
+
+    /* 池子里没有这个大小的内存, 只能真正分配一次 */
+    m_allocations ++;
+    cv::UMatData* u = new cv::UMatData(this);
+    u->data = u->origdata = (uchar*)cv::fastMalloc(bytes);
+    u->size = bytes;
+    return u;
+}
+
+// 和OpenCV默认的StdMatAllocator一样计算step和总字节数, 只是内存从池子里拿
+cv::UMatData* BufferPool::allocate(int dims, const int* sizes, int type, void* data0, size_t* step,
+                                   cv::AccessFlag, cv::UMatUsageFlags) const{
+    size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims - 1; i >= 0; i --){
+        if (step){
+            if (data0 && step[i] != CV_AUTOSTEP){
+                CV_Assert(total <= step[i]);
+                total = step[i];
+            } else {
+                step[i] = total;
+            }
+        }
+        total *= sizes[i];
+    }
+
+    /* 用户自己的内存不归池子管 */
+    if (data0){
+        cv::UMatData* u = new cv::UMatData(this);
+        u->data = u->origdata = (uchar*)data0;
+        u->size = total;
+        u->flags |= cv::UMatData::USER_ALLOCATED;
+        return u;
+    }
+
+    m_requests ++;
+    return acquire(total);
+}
+
+bool BufferPool::allocate(cv::UMatData* u, cv::AccessFlag, cv::UMatUsageFlags) const{
+    return u != nullptr;
+}
+
+void BufferPool::deallocate(cv::UMatData* u) const{
+    if (!u) return;
+    CV_Assert(u->urefcount == 0);
+    CV_Assert(u->refcount == 0);
+
+    if (u->flags & cv::UMatData::USER_ALLOCATED){
+        delete u;
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(m_mtx);
+        auto& bucket = m_free[u->size];
+        if (bucket.size() < m_maxCachedPerSize){
+            bucket.push_back(u);
+            return;
+        }
+    }
+    cv::fastFree(u->origdata);
+    u->origdata = 0;
+    delete u;
+}
+
+void BufferPool::report(long frames) const{
+    long allocs = m_allocations.load();
+    LOG("[pool] %-6s %ld creates, %ld allocations for %ld frames (%.3f allocations/frame)",
+        m_name.c_str(), m_requests.load(), allocs, frames, frames > 0 ? double(allocs) / frames : 0.0);
+}
+
+/* ------------------------------ CountingAllocator ------------------------------ */
+
+namespace {
+thread_local bool t_tracked = false;
+} // namespace
+
+CountingAllocator::CountingAllocator(string name): m_name(name) {}
+
+CountingAllocator::~CountingAllocator(){
+    uninstall();
+}
+
+void CountingAllocator::install(){
+    if (m_base) return;
+    m_base = cv::Mat::getDefaultAllocator();
+    cv::Mat::setDefaultAllocator(this);
+}
+
+void CountingAllocator::uninstall(){
+    if (!m_base) return;
+    if (cv::Mat::getDefaultAllocator() == this)
+        cv::Mat::setDefaultAllocator(m_base);
+    m_base = nullptr;
+}
+
+void CountingAllocator::track_this_thread(bool enable){
+    t_tracked = enable;
+}
+
+cv::UMatData* CountingAllocator::allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                                          cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const{
+    if (t_tracked && !data) m_allocations ++;
+    cv::MatAllocator* base = m_base ? m_base : cv::Mat::getStdAllocator();
+    return base->allocate(dims, sizes, type, data, step, flags, usageFlags);
+}
+
+bool CountingAllocator::allocate(cv::UMatData* u, cv::AccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const{
+    cv::MatAllocator* base = m_base ? m_base : cv::Mat::getStdAllocator();
+    return base->allocate(u, accessFlags, usageFlags);
+}
+
+/* 转发出去的UMatData都记着原来的allocator, 一般不会走到这里 */
+void CountingAllocator::deallocate(cv::UMatData* u) const{
+    if (u && u->currAllocator && u->currAllocator != this)
+        u->currAllocator->deallocate(u);
+}
+
+void CountingAllocator::report(long frames) const{
+    long allocs = m_allocations.load();
+    LOG("[pool] %-6s %ld allocations for %ld frames (%.3f allocations/frame, model threads only)",
+        m_name.c_str(), allocs, frames, frames > 0 ? double(allocs) / frames : 0.0);
+}
+
+} // namespace bufferpool
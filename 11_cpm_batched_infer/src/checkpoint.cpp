@@ -0,0 +1,146 @@
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "checkpoint.hpp"
+#include "logger.hpp"
+
+using namespace std;
+
+namespace checkpoint{
+
+namespace {
+
+/* 整个列表文件的FNV-1a 64, 列表只是一行一行的路径, 读一遍的开销和处理一张图片差不多 */
+bool hash_file(const string& path, uint64_t& hash){
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    hash = 0xcbf29ce484222325ull;
+    vector<uint8_t> buffer(1 << 20);
+    ssize_t n;
+    while ((n = ::read(fd, buffer.data(), buffer.size())) != 0){
+        if (n < 0){
+            if (errno == EINTR) continue;
+            ::close(fd);
+            return false;
+        }
+        for (ssize_t i = 0; i < n; i ++){
+            hash ^= buffer[i];
+            hash *= 0x100000001b3ull;
+        }
+    }
+    ::close(fd);
+    return true;
+}
+
+} // namespace
+
+Progress::Progress(int syncEvery) : m_syncEvery(syncEvery > 0 ? syncEvery : 1) {}
+
+Progress::~Progress(){
+    if (m_fd >= 0){
+        sync();
+        ::close(m_fd);
+    }
+}
+
+bool Progress::create(uint64_t listBytes, uint64_t listHash){
+    Header header{};
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version   = kVersion;
+    header.listBytes = listBytes;
+    header.listHash  = listHash;
+
+    return ftruncate(m_fd, 0) == 0 &&
+           pwrite(m_fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+           fdatasync(m_fd) == 0;
+}
+
+bool Progress::open(const string& path, const string& listFile, long& index, uint64_t& offset){
+    index  = -1;
+    offset = 0;
+
+    struct stat st;
+    uint64_t    listHash;
+    if (stat(listFile.c_str(), &st) != 0 || !hash_file(listFile, listHash)){
+        LOGW("[checkpoint] failed to read %s", listFile.c_str());
+        return false;
+    }
+    uint64_t listBytes = (uint64_t)st.st_size;
+
+    m_path = path;
+    m_fd   = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (m_fd < 0 || fstat(m_fd, &st) != 0){
+        LOGW("[checkpoint] failed to open %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    Header header{};
+    bool valid = (size_t)st.st_size >= sizeof(Header) &&
+                 pread(m_fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+                 memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 && header.version == kVersion;
+
+    if (valid && (header.listBytes != listBytes || header.listHash != listHash)){
+        LOGW("[checkpoint] %s was written for a different list, starting over", path.c_str());
+        valid = false;
+    }
+
+    if (valid){
+        /* 从最后一条往前找第一条完整的Record, 一般第一次就找到了, 恢复的开销和已经完成了多少无关 */
+        long count = long((st.st_size - sizeof(Header)) / sizeof(Record));
+        long last  = count - 1;
+        for (; last >= 0; last --){
+            Record r;
+            if (pread(m_fd, &r, sizeof(r), sizeof(Header) + last * sizeof(Record)) == (ssize_t)sizeof(r) &&
+                r.check == (r.index ^ r.offset ^ kCheckSeed)){
+                index  = (long)r.index;
+                offset = r.offset;
+                break;
+            }
+        }
+        /* 去掉写了一半的尾巴, 之后追加的Record保持对齐 */
+        valid = ftruncate(m_fd, sizeof(Header) + (last + 1) * sizeof(Record)) == 0;
+    }
+
+    if (!valid && !create(listBytes, listHash)){
+        LOGW("[checkpoint] failed to initialize %s: %s", path.c_str(), strerror(errno));
+        ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    lseek(m_fd, 0, SEEK_END);
+
+    if (index >= 0)
+        LOG("[checkpoint] resuming after entry %ld of %s", index, listFile.c_str());
+    return true;
+}
+
+void Progress::commit(long index, uint64_t offset){
+    if (m_fd < 0) return;
+
+    Record r;
+    r.index  = (uint64_t)index;
+    r.offset = offset;
+    r.check  = r.index ^ r.offset ^ kCheckSeed;
+    if (write(m_fd, &r, sizeof(r)) != (ssize_t)sizeof(r)){
+        LOGW("[checkpoint] failed to append to %s: %s", m_path.c_str(), strerror(errno));
+        return;
+    }
+    m_commits ++;
+
+    /* write只是进了page cache, 攒够了再一起落盘 */
+    if (++ m_unsynced >= m_syncEvery)
+        sync();
+}
+
+void Progress::sync(){
+    if (m_fd < 0 || m_unsynced == 0) return;
+    if (fdatasync(m_fd) != 0)
+        LOGW("[checkpoint] failed to sync %s: %s", m_path.c_str(), strerror(errno));
+    m_unsynced = 0;
+}
+
+} // namespace checkpoint
@@ -0,0 +1,76 @@
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "data_list.hpp"
+#include "logger.hpp"
+
+using namespace std;
+
+namespace datalist{
+
+void MappedList::iterator::advance(){
+    while (m_next < m_end){
+        const char* begin = m_next;
+        const char* nl    = static_cast<const char*>(memchr(begin, '\n', m_end - begin));
+        const char* stop  = nl ? nl : m_end;
+        m_next            = nl ? nl + 1 : m_end;
+
+        if (stop > begin && stop[-1] == '\r') stop --;
+        if (stop > begin){
+            m_line = string_view(begin, stop - begin);
+            return;
+        }
+    }
+    m_line = string_view();
+}
+
+MappedList::~MappedList(){
+    close();
+}
+
+bool MappedList::open(const string& file){
+    close();
+
+    int fd = ::open(file.c_str(), O_RDONLY);
+    if (fd < 0){
+        LOGW("Failed to open %s", file.c_str());
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0){
+        LOGW("Failed to stat %s", file.c_str());
+        ::close(fd);
+        return false;
+    }
+
+    /* 长度为0的文件不能mmap, 当成没有条目的列表 */
+    if (st.st_size > 0){
+        void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED){
+            LOGW("Failed to mmap %s", file.c_str());
+            ::close(fd);
+            return false;
+        }
+        /* 基本上是从头到尾顺序读, 让内核提前预读 */
+        madvise(p, st.st_size, MADV_SEQUENTIAL);
+        m_data = static_cast<const char*>(p);
+        m_size = st.st_size;
+    }
+
+    /* mmap之后fd就不需要了 */
+    ::close(fd);
+    return true;
+}
+
+void MappedList::close(){
+    if (m_data){
+        munmap(const_cast<char*>(m_data), m_size);
+        m_data = nullptr;
+        m_size = 0;
+    }
+}
+
+} // namespace datalist
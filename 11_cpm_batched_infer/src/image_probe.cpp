@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include "opencv2/opencv.hpp"
+#include "image_probe.hpp"
+
+using namespace std;
+
+namespace imgprobe{
+
+static int be16(const uint8_t* p){
+    return (p[0] << 8) | p[1];
+}
+
+static long be32(const uint8_t* p){
+    return ((long)p[0] << 24) | ((long)p[1] << 16) | ((long)p[2] << 8) | (long)p[3];
+}
+
+static bool probeJPEG(const uint8_t* data, size_t size, Info& info){
+    size_t p = 2;
+    while (p + 4 <= size){
+        if (data[p] != 0xFF) return false;
+
+        /* 段之间可以有任意多个0xFF填充 */
+        uint8_t marker = data[p + 1];
+        if (marker == 0xFF){
+            p ++;
+            continue;
+        }
+        p += 2;
+
+        /* 没有长度的段: RSTn, TEM */
+        if ((marker >= 0xD0 && marker <= 0xD7) || marker == 0x01) continue;
+        /* 在SOF之前就到了图像数据或者结尾 */
+        if (marker == 0xD9 || marker == 0xDA) return false;
+
+        int length = be16(data + p);
+        if (length < 2) return false;
+
+        /* SOF0 ~ SOF15, 除了DHT(C4), JPG(C8), DAC(CC) */
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC){
+            /* 长度(2) + 精度(1) + 高(2) + 宽(2) + 分量个数(1) */
+            if (p + 8 > size) return false;
+            info.format   = Format::JPEG;
+            info.height   = be16(data + p + 3);
+            info.width    = be16(data + p + 5);
+            info.channels = data[p + 7];
+            return info.width > 0 && info.height > 0;
+        }
+        p += length;
+    }
+    return false;
+}
+
+static bool probePNG(const uint8_t* data, size_t size, Info& info){
+    /* 签名(8) + IHDR的长度(4) + "IHDR"(4) + 宽(4) + 高(4) + 位深(1) + 颜色类型(1) */
+    if (size < 26 || memcmp(data + 12, "IHDR", 4) != 0) return false;
+
+    long w = be32(data + 16);
+    long h = be32(data + 20);
+    if (w <= 0 || h <= 0 || w > INT_MAX || h > INT_MAX) return false;
+
+    /* 颜色类型: 0灰度, 2 RGB, 3调色板, 4灰度 + alpha, 6 RGBA */
+    static const int kChannels[7] = {1, 0, 3, 3, 2, 0, 4};
+    uint8_t colorType = data[25];
+    if (colorType > 6 || kChannels[colorType] == 0) return false;
+
+    info.format   = Format::PNG;
+    info.width    = (int)w;
+    info.height   = (int)h;
+    info.channels = kChannels[colorType];
+    return true;
+}
+
+bool probe(const uint8_t* data, size_t size, Info& info){
+    static const uint8_t kPNG[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+    info = Info();
+    if (!data) return false;
+    if (size >= 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF)
+        return probeJPEG(data, size, info);
+    if (size >= 8 && memcmp(data, kPNG, 8) == 0)
+        return probePNG(data, size, info);
+    return false;
+}
+
+int decode_flag(const Info& info, int targetW, int targetH){
+    if (info.format != Format::JPEG || targetW <= 0 || targetH <= 0) return cv::IMREAD_COLOR;
+
+    /*
+     * letterbox的缩放比例, EXIF里的旋转可能让宽高对调, 两个方向取大的那个,
+     * 保证缩小之后的图片不管怎么转都不比letterbox之后的小
+     */
+    double scale = max(min((double)targetW / info.width,  (double)targetH / info.height),
+                       min((double)targetW / info.height, (double)targetH / info.width));
+
+    if (scale * 8 <= 1) return cv::IMREAD_REDUCED_COLOR_8;
+    if (scale * 4 <= 1) return cv::IMREAD_REDUCED_COLOR_4;
+    if (scale * 2 <= 1) return cv::IMREAD_REDUCED_COLOR_2;
+    return cv::IMREAD_COLOR;
+}
+
+int decode_flag(const uint8_t* data, size_t size, int targetW, int targetH){
+    Info info;
+    if (!probe(data, size, info)) return cv::IMREAD_COLOR;
+    return decode_flag(info, targetW, targetH);
+}
+
+} // namespace imgprobe
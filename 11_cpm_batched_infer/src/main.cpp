@@ -13,7 +13,10 @@ int main(){
 
     int    batchSize = 32;
 
-    auto   producer  = model::create_model(batchSize);
+    model::Options options;
+    options.numWorkers = 0;   // 0表示和CPU核数一致, 与batchSize无关
+
+    auto   producer  = model::create_model(batchSize, options);
 
     // main端只需要调用一个forward就好了
     timer.start_cpu();
@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "manifest.hpp"
+#include "data_list.hpp"
+#include "image_probe.hpp"
+#include "logger.hpp"
+
+using namespace std;
+
+namespace manifest{
+
+namespace {
+
+/*
+ * 一般SOF/IHDR都在文件的前几百个字节, 但是JPEG的EXIF里可能带着几十KB的缩略图,
+ * 先读kHeadBytes, 不够的时候再读到kMaxHeadBytes
+ */
+constexpr size_t kHeadBytes    = 64 * 1024;
+constexpr size_t kMaxHeadBytes = 1024 * 1024;
+
+/* 只读文件的开头, 填好Record里除了路径以外的部分 */
+void probe_file(const string& path, Record& r, vector<uint8_t>& head){
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0){
+        r.fileBytes = (uint64_t)st.st_size;
+
+        imgprobe::Info info;
+        for (size_t want = kHeadBytes; ; want = kMaxHeadBytes){
+            head.resize(min<size_t>(want, r.fileBytes));
+            ssize_t n = pread(fd, head.data(), head.size(), 0);
+            if (n <= 0) break;
+            if (imgprobe::probe(head.data(), (size_t)n, info) || (size_t)n < head.size() ||
+                head.size() == r.fileBytes || want == kMaxHeadBytes)
+                break;
+        }
+        r.width    = (uint32_t)info.width;
+        r.height   = (uint32_t)info.height;
+        r.channels = (uint8_t)info.channels;
+        r.format   = (uint8_t)info.format;
+    }
+    ::close(fd);
+}
+
+} // namespace
+
+bool build(const string& listFile, const string& output, int numThreads){
+    datalist::MappedList list;
+    if (!list.open(listFile)) return false;
+
+    /* 路径按列表的顺序拼进字符串区, Record里只记位置 */
+    vector<Record> records;
+    string         strings;
+    for (string_view line: list){
+        Record r{};
+        r.pathOffset = strings.size();
+        r.pathLength = (uint32_t)line.size();
+        strings.append(line.data(), line.size());
+        records.push_back(r);
+    }
+
+    /* 每个线程一次认领一小段, 慢的磁盘上也能让所有线程都有活干 */
+    constexpr size_t kChunk = 64;
+    atomic<size_t>   next{0};
+    auto worker = [&](){
+        vector<uint8_t> head;
+        string          path;
+        for (size_t begin; (begin = next.fetch_add(kChunk)) < records.size(); ){
+            size_t end = min(begin + kChunk, records.size());
+            for (size_t i = begin; i < end; i ++){
+                path.assign(strings, records[i].pathOffset, records[i].pathLength);
+                probe_file(path, records[i], head);
+            }
+        }
+    };
+
+    numThreads = max(numThreads, 1);
+    vector<thread> threads;
+    for (int i = 0; i < numThreads; i ++)
+        threads.emplace_back(worker);
+    for (auto& t: threads)
+        t.join();
+
+    size_t unknown = count_if(records.begin(), records.end(), [](const Record& r){ return r.width == 0; });
+    if (unknown > 0)
+        LOGW("%zu of %zu images have no readable JPEG/PNG header", unknown, records.size());
+
+    Header header{};
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version       = kVersion;
+    header.count         = records.size();
+    header.stringsOffset = sizeof(Header) + records.size() * sizeof(Record);
+    header.stringsBytes  = strings.size();
+
+    FILE* f = fopen(output.c_str(), "wb");
+    if (!f){
+        LOGW("Failed to create %s", output.c_str());
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    ok = ok && fwrite(records.data(), sizeof(Record), records.size(), f) == records.size();
+    ok = ok && fwrite(strings.data(), 1, strings.size(), f) == strings.size();
+    ok = (fclose(f) == 0) && ok;
+    if (!ok) LOGW("Failed to write %s", output.c_str());
+    return ok;
+}
+
+bool is_manifest(const string& path){
+    char  magic[sizeof(kMagic)];
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return false;
+    bool ok = fread(magic, 1, sizeof(magic), f) == sizeof(magic) && memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+    fclose(f);
+    return ok;
+}
+
+/* ----------------------------------- Index ----------------------------------- */
+
+Index::~Index(){
+    close();
+}
+
+bool Index::open(const string& path){
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0){
+        LOGW("Failed to open %s", path.c_str());
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header)){
+        LOGW("%s is not a manifest", path.c_str());
+        ::close(fd);
+        return false;
+    }
+
+    void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED){
+        LOGW("Failed to mmap %s", path.c_str());
+        return false;
+    }
+    m_data  = static_cast<const uint8_t*>(p);
+    m_bytes = st.st_size;
+
+    /* 只校验Header和各个区的大小, 每条记录的路径在path(i)里再检查 */
+    const Header* header = reinterpret_cast<const Header*>(m_data);
+    bool ok = memcmp(header->magic, kMagic, sizeof(kMagic)) == 0 && header->version == kVersion &&
+              header->count <= (m_bytes - sizeof(Header)) / sizeof(Record) &&
+              header->stringsOffset == sizeof(Header) + header->count * sizeof(Record) &&
+              header->stringsBytes <= m_bytes - header->stringsOffset;
+    if (!ok){
+        LOGW("%s is not a valid manifest", path.c_str());
+        close();
+        return false;
+    }
+    m_records = reinterpret_cast<const Record*>(m_data + sizeof(Header));
+    m_strings = reinterpret_cast<const char*>(m_data + header->stringsOffset);
+    m_count   = header->count;
+    return true;
+}
+
+void Index::close(){
+    if (m_data){
+        munmap(const_cast<uint8_t*>(m_data), m_bytes);
+        m_data    = nullptr;
+        m_bytes   = 0;
+        m_records = nullptr;
+        m_strings = nullptr;
+        m_count   = 0;
+    }
+}
+
+string_view Index::path(size_t i) const{
+    const Header* header = reinterpret_cast<const Header*>(m_data);
+    const Record& r      = m_records[i];
+    if (r.pathOffset > header->stringsBytes || r.pathLength > header->stringsBytes - r.pathOffset)
+        return string_view();
+    return string_view(m_strings + r.pathOffset, r.pathLength);
+}
+
+} // namespace manifest
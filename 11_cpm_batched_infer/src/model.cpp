@@ -1,8 +1,15 @@
 #include "model.hpp"
 #include "logger.hpp"
 #include "utils.hpp"
+#include "letterbox.hpp"
+#include "preprocess.hpp"
+#include "buffer_pool.hpp"
+#include "image_cache.hpp"
+#include "batch_queue.hpp"
+#include "source.hpp"
+#include "checkpoint.hpp"
 #include <vector>
-#include <future>
+#include <atomic>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
@@ -16,17 +23,108 @@ using namespace std;
 
 namespace model{
 
+/* NCHW输出用的预处理流水线: letterbox -> RGB -> 平面float(0~255), 换一种网络的输入只需要改这里 */
+using TensorPipeline = preprocess::LetterboxNCHW;
+
+// reader解码好的一帧, 以及它来自哪一路输入
+struct Frame{
+    cv::Mat  image;
+    int      stream{0};
+    long     index{0};
+    uint64_t offset{0};    // 图片列表时这一帧在列表文件里的字节位置
+};
+
 struct Job{
     cv::Mat frame;
-    shared_ptr<promise<img>> tar;
+    float*  slice{nullptr};    // NCHW时这一帧在batch tensor里的位置
+    int     index{0};          // 这一帧在batch里的位置, 结果写到对应的slot里
+};
+
+/*
+ * 一个batch的完成计数, 代替每一帧一个promise/future:
+ *  每个消费者处理完一帧就减一, 减到0的那个消费者负责唤醒生产者
+ *  生产者每个batch只等待一次, 也只会被唤醒一次
+ *  fetch_sub是acq_rel的, 之前所有消费者写的结果对最后拿锁的生产者都是可见的
+ */
+class BatchLatch{
+public:
+    void reset(int count){
+        lock_guard<mutex> lock(m_mtx);
+        m_done = false;
+        m_remaining.store(count, memory_order_relaxed);
+    }
+
+    void count_down(){
+        if (m_remaining.fetch_sub(1, memory_order_acq_rel) == 1){
+            {
+                lock_guard<mutex> lock(m_mtx);
+                m_done = true;
+            }
+            m_cv.notify_one();
+        }
+    }
+
+    void wait(){
+        unique_lock<mutex> lock(m_mtx);
+        m_cv.wait(lock, [&](){ return m_done; });
+    }
+
+private:
+    atomic<int>        m_remaining{0};
+    mutex              m_mtx;
+    condition_variable m_cv;
+    bool               m_done{false};
 };
 
 class ModelImpl : public Model{
 
 public:
-    ModelImpl(int batchSize):
-        m_batchSize(batchSize)
-    {};
+    ModelImpl(int batchSize, const Options& options):
+        /* 不使用内存池的时候池子不缓存任何内存, 只用来统计分配次数 */
+        m_inputPool("input", options.pooledBuffers ? 256 : 0),
+        m_outputPool("output", options.pooledBuffers ? 256 : 0),
+        m_otherAllocs("other"),
+        m_cache(options.cacheBytes),
+        m_targetW(options.targetW), m_targetH(options.targetH),
+        m_batchSize(batchSize), m_pipelineDepth(max(options.pipelineDepth, 1)),
+        m_numWorkers(options.numWorkers),
+        m_sourceType(options.sourceType), m_videoPath(options.videoPath), m_listPath(options.listPath), m_shardPath(options.shardPath),
+        m_streams(options.streams),
+        m_checkpointPath(options.checkpointPath), m_checkpointSync(options.checkpointSyncBatches),
+        m_numDecoders(options.numDecoders), m_frameStride(max(options.frameStride, 1)),
+        m_segmentFrames(options.segmentFrames), m_prefetch(options.prefetch),
+        m_reducedDecode(options.reducedDecode),
+        m_fusedPreprocess(options.fusedPreprocess), m_checkPreprocess(options.checkPreprocess),
+        m_countAllocations(options.countAllocations),
+        m_layout(options.layout), m_onBatch(options.onBatch), m_onFrame(options.onFrame),
+        m_maxWait(chrono::microseconds((long long)(max(options.maxWaitMs, 0.0) * 1000))),
+        m_overload(options.overload)
+    {
+        /* 丢帧只对视频和多路的流有意义, 图片列表和shard是离线的输入, 丢掉的图片就再也不会被处理了 */
+        bool video = !m_streams.empty() || m_sourceType == source::SourceType::Video;
+        if (m_overload != jobqueue::Overload::Block && !video){
+            LOGW("[producer] overload policy only applies to video sources, using Block");
+            m_overload = jobqueue::Overload::Block;
+        }
+        /* lock-step时生产者自己同步解码, 没有可以丢帧的队列 */
+        if (m_overload != jobqueue::Overload::Block && m_pipelineDepth < 2){
+            LOGW("[producer] overload policy needs a frame queue, using pipelineDepth 2");
+            m_pipelineDepth = 2;
+        }
+        /* 多路输入要靠各自的reader线程往同一个帧队列里放帧 */
+        if (m_streams.size() > 1 && m_pipelineDepth < 2){
+            LOGW("[producer] %zu streams need a frame queue, using pipelineDepth 2", m_streams.size());
+            m_pipelineDepth = 2;
+        }
+
+        if (m_numWorkers <= 0)
+            m_numWorkers = max((int)thread::hardware_concurrency(), 1);
+        if (m_numDecoders <= 0)
+            m_numDecoders = max((int)thread::hardware_concurrency(), 1);
+
+        /* 任何时候jobQueue里最多只有pipelineDepth个batch的job */
+        m_jobQueue = jobqueue::create_queue<Job>(options.queueType, m_batchSize * m_pipelineDepth, m_numWorkers);
+    };
 
     ~ModelImpl() {
         stop();
@@ -35,10 +133,11 @@ public:
     void stop() {
         if (m_running){
             m_running = false;
-            m_cv.notify_all();
+            m_jobQueue->close();
+            if (m_frameQueue) m_frameQueue->close();
         }
 
-        for (int i = 0; i < m_batchSize; i ++){
+        for (int i = 0; i < (int)m_workers.size(); i ++){
             if (m_workers[i].joinable()){
                 LOGV(DGREEN"[consumer] consumer%d release" CLEAR, i);
                 m_workers[i].join();
@@ -49,135 +148,424 @@ public:
     bool initialization(){
         m_running = true;
 
-        m_workers.reserve(m_batchSize);
+        m_workers.reserve(m_numWorkers);
         m_batchedFrames.reserve(m_batchSize);
+        m_jobs.reserve(m_batchSize);
+        m_result.images.reserve(m_batchSize);
 
-        for (int i = 0; i < m_batchSize; i ++){
-            m_workers.push_back(thread(&ModelImpl::inference, this));
+        /* 消费者的个数由numWorkers决定, batch再大也不会超额订阅CPU */
+        for (int i = 0; i < m_numWorkers; i ++){
+            m_workers.push_back(thread(&ModelImpl::inference, this, i));
             LOGV(GREEN"[producer]created consumer%d" CLEAR, i);
         }
+        if (m_fusedPreprocess)
+            LOGV(GREEN"[producer]fused letterbox uses %s" CLEAR, preprocess::simd_name());
+
+        /* 
+         * 相当于每个batch的输出预先准备好的arena:
+         *  同时在流水线里的batch最多pipelineDepth个, 每个batch的结果都能直接从池子里拿到
+         */
+        if (m_layout == Layout::NCHW){
+            /* 
+             * commits之后要等整个batch处理完才会commit下一个batch, 同一时间只有一个batch在写
+             * 所以一块[N, 3, H, W]的buffer就够了, 解码的流水线不受影响
+             */
+            m_tensor.assign(size_t(m_batchSize) * 3 * m_targetH * m_targetW, 0.f);
+        } else {
+            m_outputPool.reserve(size_t(m_targetW) * m_targetH * 3, m_batchSize * m_pipelineDepth);
+        }
         return true;
     }
 
+    /*
+     * 前向推理:
+     *  pipelineDepth == 1 时, 生产者自己解码一个batch, commit之后等待这个batch处理完, 再解码下一个batch
+     *  pipelineDepth >= 2 时, 由单独的reader线程一帧一帧地提前解码, 解码和推理互相重叠
+     *  两种方式都是dynamic batching: 凑够batchSize帧, 或者等待超过了maxWaitMs, 就把已有的帧组成一个batch
+     *  视频结束时最后不足一个batch的帧也会被处理
+     *  多路输入时每一路一个reader, 所有的输入都结束之后forward才返回
+     *  结束时会统计解码总时间, 以及其中有多少被推理所掩盖(hidden)
+    */
     void forward() override {
-        cv::VideoCapture cap("/home/phoenix/workstation/multi-thread-programming/11_cpm_batched_infer/mot_people_medium.mp4");
-        if (!cap.isOpened()) {
-            LOG("Error opening video stream");
+        auto srcs = openSources();
+        if (srcs.empty()) {
+            LOG("Error opening the input source");
             return;
         }
 
+        m_decodeTime = m_stallTime = 0;
+        m_frames     = 0;
+        m_partialBatches = 0;
+        m_streamFrames.assign(srcs.size(), 0);
+
+        /* 只统计model自己的线程(生产者, reader, 消费者, source的解码线程), 见bufferpool::CountingAllocator */
+        if (m_countAllocations){
+            m_otherAllocs.install();
+            bufferpool::CountingAllocator::track_this_thread(true);
+        }
+
+        auto start = chrono::steady_clock::now();
+
+        if (m_pipelineDepth > 1)
+            forwardPipelined(srcs);
+        else
+            forwardLockstep(*srcs[0]);
+
+        if (m_countAllocations){
+            bufferpool::CountingAllocator::track_this_thread(false);
+            m_otherAllocs.uninstall();
+        }
+
+        double hidden = max(m_decodeTime - m_stallTime, 0.0);
+        LOG("[producer] decode %.2f ms, exposed %.2f ms, hidden %.2f ms (%.1f%%)",
+            m_decodeTime, m_stallTime, hidden, m_decodeTime > 0 ? hidden * 100 / m_decodeTime : 0.0);
+        LOG("[producer] %ld frames, %d partial batches", m_frames, m_partialBatches);
+        reportThroughput(srcs, elapsedMs(start));
+        if (m_progress){
+            LOG("[producer] %ld batches checkpointed to %s", m_progress->committed(), m_checkpointPath.c_str());
+            m_progress.reset();
+        }
+        for (size_t i = 0; srcs.size() > 1 && i < srcs.size(); i ++)
+            LOG("[producer] stream %zu: %ld frames", i, m_streamFrames[i]);
+        stop();
+
+        m_inputPool.report(m_frames);
+        m_outputPool.report(m_frames);
+        m_cache.report();
+        if (m_countAllocations)
+            m_otherAllocs.report(m_frames);
+    }
+
+    /*
+     * source fps:    视频本身走过的帧(包括stride跳过的和overload丢掉的)每秒多少帧
+     * processed fps: 真正经过消费者处理的帧每秒多少帧
+     * 不是视频的source没有跳帧, 按处理的帧数算
+     */
+    void reportThroughput(const vector<unique_ptr<source::Source>>& srcs, double ms){
+        long walked = 0;
+        for (size_t i = 0; i < srcs.size(); i ++){
+            long n  = srcs[i]->source_frames();
+            walked += n >= 0 ? n : m_streamFrames[i];
+        }
+        double sec = max(ms / 1000.0, 1e-9);
+        LOG("[producer] source %.1f fps (%ld frames), processed %.1f fps (%ld frames), stride %d",
+            walked / sec, walked, m_frames / sec, m_frames, m_frameStride);
+    }
+
+    /* 有checkpointPath的时候打开进度文件, 返回上次处理完的最后一个条目; 打不开就不做checkpoint */
+    source::Position openCheckpoint(){
+        source::Position resume;
+        if (m_checkpointPath.empty()) return resume;
+
+        /* 记下的是最后一张完成的图片, 前面的图片都当成处理过了; 丢帧的话这就不成立 */
+        if (m_overload != jobqueue::Overload::Block){
+            LOGW("[checkpoint] disabled: the overload policy may drop images before they are processed");
+            return resume;
+        }
+
+        m_progress.reset(new checkpoint::Progress(m_checkpointSync));
+        if (!m_progress->open(m_checkpointPath, m_listPath, resume.index, resume.offset)){
+            m_progress.reset();
+            resume = source::Position();
+        }
+        return resume;
+    }
+
+    /* 有streams的时候每一路打开一个视频, 任何一路打不开都返回空 */
+    vector<unique_ptr<source::Source>> openSources(){
+        vector<unique_ptr<source::Source>> srcs;
+        if (m_streams.empty()){
+            auto src = openSource();
+            if (src) srcs.push_back(move(src));
+            return srcs;
+        }
+
+        /* 实时的流不能seek, 每一路都是一个VideoCapture顺序解码 */
+        for (auto& path: m_streams){
+            auto src = source::create_video_source(path, 1, m_segmentFrames, &m_inputPool, m_frameStride);
+            if (!src){
+                LOGW("[producer] failed to open stream %s", path.c_str());
+                return {};
+            }
+            srcs.push_back(move(src));
+        }
+        return srcs;
+    }
+
+    /* 解码出来的帧直接从input池里分配 */
+    unique_ptr<source::Source> openSource(){
+        if (m_sourceType == source::SourceType::ImageList)
+            return source::create_list_source(m_listPath, m_numDecoders, m_prefetch, &m_inputPool, &m_cache,
+                                              m_reducedDecode ? cv::Size(m_targetW, m_targetH) : cv::Size(),
+                                              openCheckpoint());
+        if (m_sourceType == source::SourceType::Shard)
+            return source::create_shard_source(m_shardPath);
+        return source::create_video_source(m_videoPath, m_numDecoders, m_segmentFrames, &m_inputPool, m_frameStride);
+    }
+
+    void forwardLockstep(source::Source& src){
         while (m_running){
-            if (!getBatch(cap)){
+            auto start = chrono::steady_clock::now();
+            bool ok    = getBatch(src, m_batchedFrames);
+            double ms  = elapsedMs(start);
+
+            /* lock-step下解码时消费者都在空等, 所有的解码时间都是暴露的 */
+            m_decodeTime += ms;
+            m_stallTime  += ms;
+            if (!ok){
                 break;
             }
 
-            auto results = commits();
-            for (auto& res: results) {
-                img info = res.get();
-            }
+            m_partialBatches += (int)m_batchedFrames.size() < m_batchSize;
+            commits(m_batchedFrames);
+            finish();
             m_batchedFrames.clear();
         }
-        stop();
     }
 
-    bool getBatch(cv::VideoCapture& cap){
-        for (int i = 0; i < m_batchSize; i ++) {
-            cv::Mat frame;
-            cap >> frame;
-            if (frame.empty()) {
-                return false;
-            }
-            m_batchedFrames.emplace_back(frame);
+    void forwardPipelined(vector<unique_ptr<source::Source>>& srcs){
+        /* 正在被推理的batch本身占用一个buffer, 所以最多只能有pipelineDepth - 1个batch的帧在排队 */
+        m_frameQueue.reset(new jobqueue::BatchQueue<Frame>(size_t(m_batchSize) * (m_pipelineDepth - 1), m_overload));
+
+        /* 每一路一个reader, 最后一个结束的reader负责close帧队列 */
+        vector<thread> readers;
+        vector<double> decodeTime(srcs.size(), 0);
+        m_activeReaders = (int)srcs.size();
+        for (size_t i = 0; i < srcs.size(); i ++)
+            readers.emplace_back(&ModelImpl::read, this, ref(*srcs[i]), (int)i, ref(decodeTime[i]));
+
+        while (m_running){
+            vector<Frame> batch;
+            batch.reserve(m_batchSize);
+
+            /* 生产者在这里等待的时间就是没有被掩盖掉的解码时间(包括等deadline的时间) */
+            auto start = chrono::steady_clock::now();
+            bool ok    = m_frameQueue->pop_batch(batch, m_batchSize, m_maxWait);
+            m_stallTime += elapsedMs(start);
+            if (!ok) break;
+
+            m_partialBatches += (int)batch.size() < m_batchSize;
+            commits(batch);
+            finish();
         }
-        return true;
+
+        /* 提前退出的时候reader可能还阻塞在push或者source上 */
+        m_frameQueue->close();
+        for (size_t i = 0; i < srcs.size(); i ++){
+            srcs[i]->close();
+            readers[i].join();
+            m_decodeTime += decodeTime[i];
+        }
+
+        LOG("[producer] %ld frames dropped, max queueing latency %.2f ms",
+            m_frameQueue->dropped(), m_frameQueue->max_latency().count() / 1000.0);
+        m_frameQueue.reset();
     }
 
-    vector<shared_future<img>> commits() {
-        vector<Job> jobs(m_batchSize);
-        vector<shared_future<img>> futures(m_batchSize);
+    /*
+     * reader:
+     *  一帧一帧地解码, 放进帧队列里, 队列满了就阻塞(或者按overload丢帧)
+     *  所有的输入都结束以后close帧队列, 生产者取完剩下的帧之后退出
+     *  decodeTime是这个reader自己的, join之后再由生产者加起来
+    */
+    void read(source::Source& src, int stream, double& decodeTime){
+        bufferpool::CountingAllocator::track_this_thread(true);
+        long index = 0;
+        while (m_running){
+            Frame frame;
+            frame.stream = stream;
+            frame.index  = index ++;
+
+            auto start = chrono::steady_clock::now();
+            bool ok    = src.read(frame.image);
+            decodeTime += elapsedMs(start);
+            setPosition(src, frame);
 
-        for (int i = 0; i < m_batchSize; i ++){
-            jobs[i].frame = m_batchedFrames[i];
-            jobs[i].tar.reset(new promise<img>());
-            futures[i] = jobs[i].tar->get_future();
+            if (!ok || !m_frameQueue->push(move(frame))) break;
         }
+        if (-- m_activeReaders == 0)
+            m_frameQueue->close();
+        LOGV(BLUE"[reader%d] finished reading" CLEAR, stream);
+    }
 
-        {
-            lock_guard<mutex> lock(m_mtx);
-            for (int i = 0; i < m_batchSize; i ++){
-                m_jobQueue.emplace(move(jobs[i]));
-            }
+    /* lock-step下的batch: 同步解码, 凑够batchSize帧或者超过了maxWaitMs就返回, 有帧就返回true */
+    bool getBatch(source::Source& src, vector<Frame>& frames){
+        auto start = chrono::steady_clock::now();
+        while ((int)frames.size() < m_batchSize) {
+            if (m_maxWait.count() > 0 && !frames.empty() && chrono::steady_clock::now() - start >= m_maxWait)
+                break;
+
+            Frame frame;
+            frame.index = m_frames + (long)frames.size();
+            if (!src.read(frame.image)) break;
+            setPosition(src, frame);
+            frames.push_back(move(frame));
         }
+        return !frames.empty();
+    }
 
-        m_cv.notify_all();
+    /* 图片列表的帧编号就是它在列表里的下标, 并且带上字节位置, 给checkpoint用 */
+    static void setPosition(const source::Source& src, Frame& frame){
+        source::Position pos;
+        if (src.position(pos)){
+            frame.index  = pos.index;
+            frame.offset = pos.offset;
+        }
+    }
+
+    /* 
+     * 结果的slot和job的数组都是预先分配好的, 每个batch重复使用
+     * 一个batch只需要reset一次latch, 不再为每一帧new一个promise
+    */
+    void commits(const vector<Frame>& frames) {
+        int n = (int)frames.size();
+        m_result.images.resize(n);
+        m_latch.reset(n);
+
+        m_frames += n;
+        m_jobs.resize(n);
+        for (int i = 0; i < n; i ++){
+            /* 消费者只写data和path, 来自哪一路由生产者在push之前填好 */
+            m_result.images[i].stream = frames[i].stream;
+            m_result.images[i].frame  = frames[i].index;
+            m_streamFrames[frames[i].stream] ++;
+
+            m_jobs[i].frame = frames[i].image;
+            m_jobs[i].index = i;
+            if (m_layout == Layout::NCHW)
+                m_jobs[i].slice = m_tensor.data() + size_t(i) * 3 * m_targetH * m_targetW;
+        }
+
+        m_batchEnd = source::Position{frames[n - 1].index, frames[n - 1].offset};
+        m_jobQueue->push_bulk(m_jobs);
+        m_jobs.clear();
 
         LOGV(BLUE"[producer]finished commits" CLEAR);
-        return futures;
     }
 
-    void inference() {
-        while(m_running){
-            Job job;
-            img result;
+    /* 等待batch里所有的帧处理完, 再把整个batch交给onBatch */
+    void finish(){
+        m_latch.wait();
 
-            {
-                unique_lock<mutex> lock(m_mtx);
+        if (m_layout == Layout::NCHW){
+            m_result.input.data = m_tensor.data();
+            m_result.input.n    = (int)m_result.images.size();
+            m_result.input.h    = m_targetH;
+            m_result.input.w    = m_targetW;
+        }
 
-                m_cv.wait(lock, [&](){
-                    return !m_running || !m_jobQueue.empty();
-                });
+        if (m_onBatch)
+            m_onBatch(m_result);
+        if (m_onFrame){
+            for (auto& res: m_result.images)
+                m_onFrame(res);
+        }
 
-                if (!m_running) break;
+        /* 回调都返回之后这个batch才算完成, batch按顺序完成, 所以记最后一帧的位置就够了 */
+        if (m_progress)
+            m_progress->commit(m_batchEnd.index, m_batchEnd.offset);
 
-                job = m_jobQueue.front();
-                m_jobQueue.pop();
-            }
-            LOGV(DGREEN"[consumer] Consumer processing a frame" CLEAR);
-
-            auto  image    = job.frame;
-            int   input_w  = image.cols;
-            int   input_h  = image.rows;
-            int   target_w = 800;
-            int   target_h = 800;
-            float scale    = min(float(target_w)/input_w, float(target_h)/input_h);
-            int   new_w    = int(input_w * scale);
-            int   new_h    = int(input_h * scale);
-            
-            cv::Mat tar(target_w, target_h, CV_8UC3, cv::Scalar(0, 0, 0));
-            cv::Mat tmp;
-            cv::resize(image, tmp, cv::Size(new_w, new_h));
+        /* 结果的内存还给池子, slot本身留着下一个batch用 */
+        for (auto& res: m_result.images)
+            res.data.release();
+    }
 
-            int x, y;
-            x = (new_w < target_w) ? (target_w - new_w) / 2 : 0;
-            y = (new_h < target_h) ? (target_h - new_h) / 2 : 0;
+    void inference(int worker) {
+        bufferpool::CountingAllocator::track_this_thread(true);
+        while(m_running){
+            Job job;
 
-            cv::Rect roi(x, y, new_w, new_h);
+            /* jobQueue被close并且已经取空了, consumer退出 */
+            if (!m_jobQueue->pop(worker, job)) break;
+            LOGV(DGREEN"[consumer] Consumer processing a frame" CLEAR);
+            img& result = m_result.images[job.index];
+
+            if (m_layout == Layout::NCHW){
+                /* 直接写进batch tensor里自己的那一片, 没有中间的Mat, 也不需要再gather一次 */
+                TensorPipeline::run(job.frame, job.slice, m_targetW, m_targetH);
+                result.path = generateUniquePath();
+                m_latch.count_down();
+                LOGV(DGREEN"[consumer] Finished processing, wrote slice %p" CLEAR, job.slice);
+                continue;
+            }
 
-            cv::Mat roiOfTar = tar(roi);
-            tmp.copyTo(roiOfTar);
+            /* letterbox, 融合实现每一行只写一次, 不再需要tmp和两次cvtColor */
+            cv::Mat tar;
+            m_outputPool.attach(tar);
+            if (m_fusedPreprocess)
+                preprocess::letterbox(job.frame, tar, m_targetW, m_targetH);
+            else
+                preprocess::letterbox_opencv(job.frame, tar, m_targetW, m_targetH);
 
-            cv::cvtColor(tar, tar, cv::COLOR_BGR2RGB);
-            cv::cvtColor(tar, tar, cv::COLOR_RGB2BGR);
+            if (m_checkPreprocess)
+                preprocess::letterbox_check(job.frame, m_targetW, m_targetH);
 
             result.path = generateUniquePath();  // Set a generic path for now
             result.data = tar;
 
-            job.tar->set_value(result);
             // cv::imwrite(result.path, result.data);
             LOGV(DGREEN"[consumer] Finished processing, save to %s" CLEAR, result.path.c_str());
+
+            /* count_down之后这个slot就属于生产者了, 不能再碰result */
+            m_latch.count_down();
         }
     }
 
 private:
-    vector<cv::Mat>    m_batchedFrames;
+    /* 内存池要比所有的帧和结果活得久, 所以放在最前面, 最后析构 */
+    bufferpool::BufferPool m_inputPool;
+    bufferpool::BufferPool m_outputPool;
+    bufferpool::CountingAllocator m_otherAllocs;
+    imgcache::ImageCache   m_cache;         // 缓存的帧来自input池, 所以要比池子先析构
+    long               m_frames{0};
+    int                m_targetW;
+    int                m_targetH;
+
+    vector<Frame>      m_batchedFrames;
     int                m_batchSize;
+    int                m_pipelineDepth;
+    int                m_numWorkers;
+    source::SourceType m_sourceType;
+    string             m_videoPath;
+    string             m_listPath;
+    string             m_shardPath;
+    vector<string>     m_streams;
+    string             m_checkpointPath;
+    int                m_checkpointSync;
+    unique_ptr<checkpoint::Progress> m_progress;   // 图片列表的进度文件, 没有checkpoint的时候为空
+    source::Position   m_batchEnd;          // 当前batch最后一帧的位置
+    vector<long>       m_streamFrames;      // 每一路处理了多少帧
+    atomic<int>        m_activeReaders{0};  // 还没有结束的reader个数
+    int                m_numDecoders;
+    int                m_frameStride;
+    int                m_segmentFrames;
+    int                m_prefetch;
+    bool               m_reducedDecode;
+    bool               m_fusedPreprocess;
+    bool               m_checkPreprocess;
+    bool               m_countAllocations;
+    Layout             m_layout;
+    function<void(const batch&)> m_onBatch;
+    function<void(const img&)>   m_onFrame;
+    vector<Job>        m_jobs;              // 每个batch重复使用的job数组
+    batch              m_result;            // 每一帧结果的slot, 消费者按job.index直接写
+    BatchLatch         m_latch;
+    vector<float>      m_tensor;            // NCHW时预先分配的[N, 3, H, W]
+    chrono::microseconds m_maxWait;         // dynamic batching的deadline, 0表示一直等到凑够batch
+    jobqueue::Overload m_overload;          // 帧队列满了之后阻塞还是丢帧
+    unique_ptr<jobqueue::BatchQueue<Frame>> m_frameQueue;    // reader解码好, 等待组成batch的帧
+    int                m_partialBatches{0}; // 不足batchSize就被发出去的batch个数
+    double             m_decodeTime{0};     // 解码所用的总时间(ms)
+    double             m_stallTime{0};      // 生产者等待解码的总时间(ms)
     int                m_frameIndex{0};   // 当前帧编号
-    queue<Job>         m_jobQueue;
-    mutex              m_mtx;
-    condition_variable m_cv;
+    unique_ptr<jobqueue::JobQueue<Job>> m_jobQueue;
     vector<thread>     m_workers;
     bool               m_running{false};
 
+    static double elapsedMs(chrono::steady_clock::time_point start) {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    }
+
     string generateUniquePath() {
         ostringstream ss;
         // 如果数字的宽度不足 6 位，空白位置将被填充为零。
@@ -186,8 +574,8 @@ private:
     }
 };
 
-std::shared_ptr<Model> create_model (int batchSize){
-    shared_ptr<ModelImpl> ins(new ModelImpl(batchSize));
+std::shared_ptr<Model> create_model (int batchSize, const Options& options){
+    shared_ptr<ModelImpl> ins(new ModelImpl(batchSize, options));
     if (!ins->initialization())
         ins.reset(); //释放shared_ptr所拥有的对象
     return ins;
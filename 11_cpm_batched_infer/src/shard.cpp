@@ -0,0 +1,182 @@
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "shard.hpp"
+#include "logger.hpp"
+
+using namespace std;
+
+namespace shard{
+
+namespace {
+
+uint64_t frame_bytes(const Entry& e){
+    return uint64_t(e.rows) * e.cols * CV_ELEM_SIZE(e.type);
+}
+
+/*
+ * 一帧的索引是不是在[sizeof(Header), end)里面, 所有的比较都先减后比, 不会溢出
+ *  rows/cols要能放进cv::Mat的int, type要在OpenCV的type的范围里
+ */
+bool valid_entry(const Entry& e, uint64_t end){
+    if (e.rows > INT32_MAX || e.cols > INT32_MAX) return false;
+    if (e.type < 0 || e.type >= (CV_CN_MAX << CV_CN_SHIFT)) return false;
+    if (e.offset < sizeof(Header) || e.offset > end) return false;
+
+    uint64_t elem = CV_ELEM_SIZE(e.type);
+    uint64_t room = end - e.offset;
+    if (e.cols != 0 && uint64_t(e.rows) > room / e.cols) return false;
+    return uint64_t(e.rows) * e.cols <= room / elem;
+}
+
+} // namespace
+
+/* ----------------------------------- Writer ----------------------------------- */
+
+Writer::~Writer(){
+    if (m_file) fclose(m_file);
+}
+
+bool Writer::open(const string& path){
+    m_file = fopen(path.c_str(), "wb");
+    if (!m_file){
+        LOGW("Failed to create %s", path.c_str());
+        return false;
+    }
+
+    /* 先占住Header的位置, finish的时候再回头写 */
+    Header header{};
+    m_entries.clear();
+    m_offset = 0;
+    if (fwrite(&header, sizeof(header), 1, m_file) != 1) return false;
+    m_offset = sizeof(header);
+    return true;
+}
+
+bool Writer::pad(uint64_t alignment){
+    static const char zeros[kAlignment] = {0};
+    uint64_t n = (alignment - m_offset % alignment) % alignment;
+    if (n && fwrite(zeros, 1, n, m_file) != n) return false;
+    m_offset += n;
+    return true;
+}
+
+bool Writer::add(const cv::Mat& frame){
+    if (!m_file || frame.empty()) return false;
+    if (!pad(kAlignment)) return false;
+
+    Entry e{};
+    e.offset = m_offset;
+    e.rows   = frame.rows;
+    e.cols   = frame.cols;
+    e.type   = frame.type();
+
+    /* 不连续的Mat(比如ROI)一行一行地写, 写进去之后行是连续的 */
+    size_t row = size_t(frame.cols) * frame.elemSize();
+    for (int r = 0; r < frame.rows; r ++){
+        if (fwrite(frame.ptr<uchar>(r), 1, row, m_file) != row) return false;
+    }
+    m_offset += uint64_t(row) * frame.rows;
+    m_entries.push_back(e);
+    return true;
+}
+
+bool Writer::finish(){
+    if (!m_file) return false;
+
+    bool ok = pad(alignof(Entry));
+    Header header{};
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version     = kVersion;
+    header.count       = (uint32_t)m_entries.size();
+    header.indexOffset = m_offset;
+    header.alignment   = kAlignment;
+
+    ok = ok && fwrite(m_entries.data(), sizeof(Entry), m_entries.size(), m_file) == m_entries.size();
+    ok = ok && fseek(m_file, 0, SEEK_SET) == 0;
+    ok = ok && fwrite(&header, sizeof(header), 1, m_file) == 1;
+    ok = (fclose(m_file) == 0) && ok;
+    m_file = nullptr;
+    return ok;
+}
+
+/* ----------------------------------- Reader ----------------------------------- */
+
+Reader::~Reader(){
+    close();
+}
+
+bool Reader::open(const string& path){
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0){
+        LOGW("Failed to open %s", path.c_str());
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header)){
+        LOGW("%s is not a shard", path.c_str());
+        ::close(fd);
+        return false;
+    }
+
+    /* MAP_PRIVATE: 写时复制, 返回出去的Mat就算被写了也不会改到文件 */
+    void* p = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED){
+        LOGW("Failed to mmap %s", path.c_str());
+        return false;
+    }
+    m_data  = static_cast<uint8_t*>(p);
+    m_bytes = st.st_size;
+
+    /* 校验Header和索引, 保证后面frame(i)不会越界 */
+    const Header* header = reinterpret_cast<const Header*>(m_data);
+    /* 先检查索引本身在文件里面, 再检查每一帧都在Header和索引之间, 比较的时候都不会溢出 */
+    bool ok = memcmp(header->magic, kMagic, sizeof(kMagic)) == 0 && header->version == kVersion &&
+              header->indexOffset >= sizeof(Header) && header->indexOffset <= m_bytes &&
+              header->indexOffset % alignof(Entry) == 0 &&
+              header->count <= (m_bytes - header->indexOffset) / sizeof(Entry);
+    if (ok){
+        m_index = reinterpret_cast<const Entry*>(m_data + header->indexOffset);
+        m_count = header->count;
+        for (size_t i = 0; ok && i < m_count; i ++)
+            ok = valid_entry(m_index[i], header->indexOffset);
+    }
+    if (!ok){
+        LOGW("%s is not a valid shard", path.c_str());
+        close();
+        return false;
+    }
+
+    /* 基本上是顺序读 */
+    madvise(m_data, m_bytes, MADV_SEQUENTIAL);
+    return true;
+}
+
+void Reader::close(){
+    if (m_data){
+        munmap(m_data, m_bytes);
+        m_data  = nullptr;
+        m_bytes = 0;
+        m_index = nullptr;
+        m_count = 0;
+    }
+}
+
+cv::Mat Reader::frame(size_t i) const{
+    const Entry& e = m_index[i];
+    return cv::Mat(e.rows, e.cols, e.type, m_data + e.offset);
+}
+
+void Reader::prefetch(size_t i) const{
+    if (i >= m_count) return;
+    const Entry& e = m_index[i];
+    madvise(m_data + e.offset, frame_bytes(e), MADV_WILLNEED);
+}
+
+} // namespace shard
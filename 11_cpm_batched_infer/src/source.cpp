@@ -0,0 +1,618 @@
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "source.hpp"
+#include "buffer_pool.hpp"
+#include "data_list.hpp"
+#include "shard.hpp"
+#include "image_probe.hpp"
+#include "manifest.hpp"
+#include "job_queue.hpp"
+#include "logger.hpp"
+
+using namespace std;
+
+namespace source{
+
+namespace {
+
+bool read_frame(cv::VideoCapture& cap, cv::Mat& frame, cv::MatAllocator* allocator){
+    /* 解码直接写进allocator的内存, 上一轮用完的帧会被复用 */
+    frame.release();
+    if (allocator) frame.allocator = allocator;
+    return cap.grab() && cap.retrieve(frame) && !frame.empty();
+}
+
+/* 
+ * 读出帧号是stride倍数的下一帧, next是cap下一次会解码出来的帧号, 每走过一帧都加一
+ * 中间跳过的帧只grab, 不retrieve
+ */
+bool read_strided(cv::VideoCapture& cap, cv::Mat& frame, cv::MatAllocator* allocator, int stride,
+                  long& next, atomic<long>& walked){
+    while (next % stride != 0){
+        if (!cap.grab()) return false;
+        next ++;
+        walked ++;
+    }
+    if (!read_frame(cap, frame, allocator)) return false;
+    next ++;
+    walked ++;
+    return true;
+}
+
+// 一个VideoCapture顺序解码
+class VideoSource : public Source{
+public:
+    VideoSource(cv::MatAllocator* allocator, int stride) : m_allocator(allocator), m_stride(stride) {}
+
+    bool open(const string& path){
+        return m_cap.open(path);
+    }
+
+    bool read(cv::Mat& frame) override{
+        if (m_closed) return false;
+        return read_strided(m_cap, frame, m_allocator, m_stride, m_next, m_walked);
+    }
+
+    void close() override{
+        m_closed = true;
+    }
+
+    long source_frames() const override { return m_walked.load(); }
+
+private:
+    cv::VideoCapture   m_cap;
+    cv::MatAllocator*  m_allocator;
+    int                m_stride;
+    long               m_next{0};       // cap下一次会解码出来的帧号
+    atomic<long>       m_walked{0};     // 包括跳过的帧在内一共走过的帧数
+    atomic<bool>       m_closed{false};
+};
+
+/*
+ * 分段并行解码:
+ *  第k段是[k * segmentFrames, (k + 1) * segmentFrames)帧, 由第k % numDecoders个解码线程负责
+ *  每个解码线程解码完一段就往自己的队列里放一个结束标记, 然后seek到自己的下一段
+ *  read按段的顺序从对应的解码线程的队列里取帧, 取到结束标记就换到下一段(下一个解码线程)
+ *  队列正好能放下一整段, 所以read在取第k段的时候, 其他线程都在解码自己的段, 不会互相等待
+ *
+ *  seek确认不了的时候整个source退回顺序解码:
+ *  第一个发现的线程从头打开文件, 之后按顺序解码所有还没有被认领的段, 放进各段原来的队列里;
+ *  其他线程做完手上已经认领的段就停下来, 不再seek, 这样整个视频最多只从头多解码一遍
+ */
+class SegmentedVideoSource : public Source{
+public:
+    struct Item{
+        cv::Mat frame;
+        bool    end{false};   // 这一段结束了
+    };
+
+    enum class Seek{
+        Exact,      // 下一次grab出来的正好是段的开头
+        Inexact,    // 停在了后面, 不支持seek, 或者时间戳对不上, cap的位置不确定
+        End         // 文件比帧数短, 到不了段的开头
+    };
+
+    SegmentedVideoSource(int numDecoders, int segmentFrames, cv::MatAllocator* allocator, int stride) :
+        m_numDecoders(numDecoders), m_segmentFrames(segmentFrames), m_allocator(allocator), m_stride(stride) {}
+
+    ~SegmentedVideoSource(){
+        close();
+        for (auto& t: m_threads){
+            if (t.joinable()) t.join();
+        }
+        if (m_seekShort > 0 || m_seekReopen > 0)
+            LOG("[source] inexact seeks: %ld stopped short (grabbed forward), %ld unverified (decoded from the start)",
+                m_seekShort.load(), m_seekReopen.load());
+    }
+
+    bool open(const string& path){
+        m_path = path;
+        cv::VideoCapture probe(path);
+        if (!probe.isOpened()) return false;
+
+        /* 帧数只是用来切段的, 不准的时候最后一段会一直解码到文件结束 */
+        long frames = (long)probe.get(cv::CAP_PROP_FRAME_COUNT);
+        m_fps       = probe.get(cv::CAP_PROP_FPS);
+        m_numSegments = max<long>((frames + m_segmentFrames - 1) / m_segmentFrames, 1);
+        m_numDecoders = (int)min<long>(m_numDecoders, m_numSegments);
+        probe.release();
+
+        /* 没有帧率就没法用时间戳确认seek的位置, 只能顺序解码 */
+        if (m_fps <= 0 && m_numDecoders > 1){
+            LOGW("[source] %s reports no frame rate, seeks can not be verified, decoding sequentially", path.c_str());
+            m_numDecoders = 1;
+        }
+
+        m_claims.reset(new atomic<int>[m_numSegments]());
+        m_retired.assign(m_numDecoders, false);
+        for (int i = 0; i < m_numDecoders; i ++){
+            m_caps.emplace_back(new cv::VideoCapture(path));
+            if (!m_caps[i]->isOpened()) return false;
+            m_queues.emplace_back(new jobqueue::MutexQueue<Item>(m_segmentFrames + 1));
+        }
+        for (int i = 0; i < m_numDecoders; i ++){
+            m_threads.emplace_back(&SegmentedVideoSource::decode, this, i);
+        }
+
+        LOG("[source] %ld frames, %ld segments of %d frames, %d decoders",
+            frames, m_numSegments, m_segmentFrames, m_numDecoders);
+        return true;
+    }
+
+    bool read(cv::Mat& frame) override{
+        while (m_segment < m_numSegments){
+            Item item;
+            if (!m_queues[m_segment % m_numDecoders]->pop(item)) return false;
+
+            if (item.end){
+                m_segment ++;
+                continue;
+            }
+            frame = item.frame;
+            return true;
+        }
+        return false;
+    }
+
+    void close() override{
+        for (auto& q: m_queues) q->close();
+        {
+            lock_guard<mutex> l(m_lock);
+            m_closed = true;
+        }
+        m_retire.notify_all();
+    }
+
+    long source_frames() const override { return m_walked.load(); }
+
+private:
+    /*
+     * 定位到第first帧, 也就是下一次grab出来的是第first帧
+     *  FFmpeg后端按帧号seek在有B帧或者可变帧率的文件上不精确, 可能停在first前面或者后面几帧
+     *  CAP_PROP_POS_FRAMES是后端自己从时间戳换算的, 和seek用的同一套算法, 只能看出停在前面还是后面:
+     *  停在前面的时候先grab到first, 然后用上一帧(first - 1)的时间戳和(first - 1) / fps独立地比较一次,
+     *  差了半帧以上就是Inexact
+     */
+    Seek seek(cv::VideoCapture& cap, long first){
+        long pos = -1;
+        if (cap.set(cv::CAP_PROP_POS_FRAMES, (double)first))
+            pos = (long)cap.get(cv::CAP_PROP_POS_FRAMES);
+        if (pos < 0 || pos > first) return Seek::Inexact;
+
+        if (pos < first) m_seekShort ++;
+        for (; pos < first; pos ++){
+            if (!cap.grab()) return Seek::End;
+        }
+
+        double expected = (first - 1) * 1000. / m_fps;
+        if (fabs(cap.get(cv::CAP_PROP_POS_MSEC) - expected) > 500. / m_fps) return Seek::Inexact;
+        return Seek::Exact;
+    }
+
+    // 从头打开文件, 顺序grab到第first帧
+    bool reopen(cv::VideoCapture& cap, long first){
+        m_seekReopen ++;
+        if (!cap.open(m_path)) return false;
+        for (long pos = 0; pos < first; pos ++){
+            if (!cap.grab()) return false;
+        }
+        return true;
+    }
+
+    // 每一段只由一个线程解码: 原来负责的线程或者顺序解码的线程, 先认领的解码
+    bool claim(long seg, int decoder){
+        int unclaimed = 0;
+        return m_claims[seg].compare_exchange_strong(unclaimed, decoder + 1);
+    }
+
+    void retire(int decoder){
+        {
+            lock_guard<mutex> l(m_lock);
+            m_retired[decoder] = true;
+        }
+        m_retire.notify_all();
+    }
+
+    // 等第decoder个线程停下来, 之后它的队列只有顺序解码的线程在放; close了返回false
+    bool wait_retired(int decoder){
+        unique_lock<mutex> l(m_lock);
+        m_retire.wait(l, [&]{ return m_retired[decoder] || m_closed; });
+        return !m_closed;
+    }
+
+    bool push_end(jobqueue::MutexQueue<Item>& q){
+        Item end;
+        end.end = true;
+        return q.push(move(end));
+    }
+
+    void decode(int decoder){
+        bufferpool::CountingAllocator::track_this_thread(true);
+        decode_segments(decoder);
+        retire(decoder);
+    }
+
+    void decode_segments(int decoder){
+        cv::VideoCapture& cap  = *m_caps[decoder];
+        auto&             q    = *m_queues[decoder];
+        long              next = 0;   // cap下一次会解码出来的帧号
+
+        for (long seg = decoder; seg < m_numSegments; seg += m_numDecoders){
+            /* 已经退回顺序解码了, 剩下的段都由顺序解码的线程负责 */
+            if (m_sequential || !claim(seg, decoder)) return;
+
+            long first = seg * m_segmentFrames;
+            if (next != first){
+                Seek r = seek(cap, first);
+                if (r == Seek::Inexact){
+                    /* 第一个发现的线程接着顺序地解码剩下所有的段 */
+                    if (!m_sequential.exchange(true)){
+                        LOGW("[decoder%d] seek to frame %ld could not be verified, decoding the rest sequentially",
+                            decoder, first);
+                        decode_sequential(decoder, cap, seg);
+                        return;
+                    }
+                    /* 这一段已经认领了, 只能自己从头grab过来; 之后不再认领新的段, 每个线程最多一次 */
+                    r = reopen(cap, first) ? Seek::Exact : Seek::End;
+                }
+                /* 定位不到段的开头(比如文件比帧数短)时跳过这一段, 还是要放结束标记, 不然read会一直等 */
+                if (r == Seek::End){
+                    LOGW("[decoder%d] failed to seek to frame %ld, segment %ld skipped", decoder, first, seg);
+                    next = -1;
+                    if (!push_end(q)) return;
+                    continue;
+                }
+                next = first;
+            }
+            if (!decode_segment(cap, q, seg, next)) return;
+        }
+    }
+
+    /*
+     * 退回顺序解码: 从头打开文件, 负责第seg段和所有还没有被认领的段
+     *  别的线程看到退回了顺序解码就不再认领, 所以seg前面也可能有没人认领的段
+     *  已经被别的线程认领的段还是由那个线程解码, 这里只grab过去
+     *  往别的线程的队列里放帧之前要等它停下来, 不然两段的帧会在队列里交错
+     */
+    void decode_sequential(int decoder, cv::VideoCapture& cap, long seg){
+        m_seekReopen ++;
+        bool ok   = cap.open(m_path);
+        long next = 0;
+
+        for (long t = 0; t < m_numSegments; t ++){
+            if (t != seg && !claim(t, decoder)) continue;
+
+            int owner = (int)(t % m_numDecoders);
+            if (owner != decoder && !wait_retired(owner)) return;
+
+            auto& q     = *m_queues[owner];
+            long  first = t * m_segmentFrames;
+            /* 跳帧时段尾没有grab的帧, 以及别的线程负责的段, 都在这里grab过去 */
+            for (; ok && next < first; next ++) ok = cap.grab();
+            if (!ok){
+                LOGW("[decoder%d] failed to reach frame %ld, segment %ld skipped", decoder, first, t);
+                if (!push_end(q)) return;
+                continue;
+            }
+            if (!decode_segment(cap, q, t, next)) return;
+        }
+    }
+
+    // next是第seg段的开头, 一直解码到段的结尾(最后一段到文件结束), 最后放结束标记; 队列关闭了返回false
+    bool decode_segment(cv::VideoCapture& cap, jobqueue::MutexQueue<Item>& q, long seg, long& next){
+        long last = (seg == m_numSegments - 1) ? -1 : (seg + 1) * m_segmentFrames;
+
+        /* 跳帧按全局的帧号算, 和怎么分段无关; 段的最后几帧跳过之后就不再grab下一段的帧 */
+        while (last < 0 || next < last){
+            Item item;
+            if (last >= 0 && (last - 1) / m_stride * m_stride < next){
+                m_walked += last - next;
+                break;
+            }
+            if (!read_strided(cap, item.frame, m_allocator, m_stride, next, m_walked)) break;
+            if (!q.push(move(item))) return false;
+        }
+
+        if (!push_end(q)) return false;
+        LOGV(BLUE"[decoder%d] finished segment %ld" CLEAR, (int)(seg % m_numDecoders), seg);
+        return true;
+    }
+
+    int                m_numDecoders;
+    int                m_segmentFrames;
+    cv::MatAllocator*  m_allocator;
+    int                m_stride;
+    double             m_fps{0};
+    atomic<long>       m_walked{0};      // 所有解码线程一共走过的帧数, 包括跳过的
+    long               m_numSegments{0};
+    long               m_segment{0};     // read当前在取的段
+    string             m_path;
+    atomic<long>       m_seekShort{0};   // seek停在了段的开头前面, 往后grab补齐的次数
+    atomic<long>       m_seekReopen{0};  // seek确认不了, 从头打开文件的次数
+    atomic<bool>       m_sequential{false};     // 已经退回顺序解码了
+    unique_ptr<atomic<int>[]> m_claims;         // 每一段由哪个线程认领了(decoder + 1), 0是还没有
+    mutex              m_lock;
+    condition_variable m_retire;
+    vector<bool>       m_retired;        // 解码线程已经停下来了, 不会再往自己的队列里放东西
+    bool               m_closed{false};
+    vector<unique_ptr<cv::VideoCapture>> m_caps;
+    vector<unique_ptr<jobqueue::MutexQueue<Item>>> m_queues;
+    vector<thread>     m_threads;
+};
+
+/*
+ * 图片列表的预取:
+ *  窗口是一个prefetch大小的环形数组, 第i张图片放在slots[i % prefetch]
+ *  解码线程认领第i张图片之前要等到 i < m_next + prefetch, 也就是read已经把对应的slot取走了
+ *  read只等第m_next张图片, 后面的图片可能已经解码好了, 但是不会乱序
+ *  列表是mmap进来的, 解码线程认领图片的时候才往后读一行, 不会先把整个列表读成vector<string>
+ */
+class ListSource : public Source{
+public:
+    struct Slot{
+        cv::Mat  frame;
+        Position pos;
+        bool     ready{false};
+    };
+
+    ListSource(int numDecoders, int prefetch, cv::MatAllocator* allocator, imgcache::ImageCache* cache, cv::Size reduceTo) :
+        m_numDecoders(numDecoders), m_allocator(allocator), m_cache(cache), m_reduceTo(reduceTo), m_slots(prefetch) {}
+
+    ~ListSource(){
+        close();
+        for (auto& t: m_threads){
+            if (t.joinable()) t.join();
+        }
+        if (m_reduced > 0)
+            LOG("[source] %ld images decoded at reduced resolution", m_reduced.load());
+    }
+
+    bool open(const string& listFile, const Position& resumeAfter){
+        /* tools/build_manifest生成的索引: 路径和宽高都已经在里面了, 解码之前不需要再看文件头 */
+        m_manifest = manifest::is_manifest(listFile);
+        if (m_manifest){
+            if (!m_index.open(listFile) || m_index.size() == 0) return false;
+        } else {
+            if (!m_list.open(listFile) || m_list.empty()) return false;
+            m_cursor = m_list.begin();
+        }
+
+        /* 从上次完成的条目的下一个开始, 条目的编号接着上次的往下数 */
+        if (resumeAfter.index >= 0){
+            if (!m_manifest && !m_list.line_start(resumeAfter.offset)){
+                LOGW("[source] resume offset %lu is not at a line start, starting over", (unsigned long)resumeAfter.offset);
+            } else {
+                if (!m_manifest){
+                    m_cursor = m_list.at(resumeAfter.offset);
+                    if (m_cursor != m_list.end()) ++ m_cursor;
+                }
+                m_claimed = m_next = resumeAfter.index + 1;
+            }
+        }
+
+        for (int i = 0; i < m_numDecoders; i ++){
+            m_threads.emplace_back(&ListSource::decode, this, i);
+        }
+        if (m_manifest)
+            LOG("[source] manifest of %zu images, %d decoders, prefetch %zu", m_index.size(), m_numDecoders, m_slots.size());
+        else
+            LOG("[source] %zu bytes of list, %d decoders, prefetch %zu", m_list.bytes(), m_numDecoders, m_slots.size());
+        return true;
+    }
+
+    bool read(cv::Mat& frame) override{
+        while (true){
+            {
+                unique_lock<mutex> lock(m_mtx);
+                Slot& slot = m_slots[m_next % m_slots.size()];
+                m_ready.wait(lock, [&](){ return m_closed || slot.ready || finished(); });
+                if (m_closed || !slot.ready) return false;
+
+                frame = move(slot.frame);
+                slot.frame.release();
+                slot.ready = false;
+                m_pos      = slot.pos;
+                m_next ++;
+            }
+            /* 空出了一个slot, 唤醒等待窗口的解码线程 */
+            m_free.notify_all();
+
+            /* 解码失败的图片是空的, 直接跳过 */
+            if (!frame.empty()) return true;
+        }
+    }
+
+    void close() override{
+        {
+            lock_guard<mutex> lock(m_mtx);
+            m_closed = true;
+        }
+        m_ready.notify_all();
+        m_free.notify_all();
+    }
+
+    /* 只会在read的线程里调用 */
+    bool position(Position& pos) const override{
+        pos = m_pos;
+        return pos.index >= 0;
+    }
+
+private:
+    void decode(int decoder){
+        bufferpool::CountingAllocator::track_this_thread(true);
+        vector<uchar> bytes;
+        string        path;
+        while (true){
+            long           index;
+            uint64_t       offset = 0;
+            imgprobe::Info info;
+            bool           known = false;   // manifest里已经有宽高了
+            {
+                unique_lock<mutex> lock(m_mtx);
+                m_free.wait(lock, [&](){
+                    return m_closed || m_exhausted || m_claimed < m_next + (long)m_slots.size();
+                });
+                if (m_closed || m_exhausted) break;
+
+                /* 认领列表里的下一行, 列表读完了就唤醒read, 让它取完剩下的图片之后结束 */
+                if (m_manifest ? (size_t)m_claimed >= m_index.size() : m_cursor == m_list.end()){
+                    m_exhausted = true;
+                    lock.unlock();
+                    m_ready.notify_all();
+                    m_free.notify_all();
+                    break;
+                }
+                if (m_manifest){
+                    const manifest::Record& r = m_index[m_claimed];
+                    string_view p = m_index.path(m_claimed);
+                    path.assign(p.data(), p.size());
+                    info.format   = (imgprobe::Format)r.format;
+                    info.width    = (int)r.width;
+                    info.height   = (int)r.height;
+                    info.channels = r.channels;
+                    known         = r.width > 0;
+                } else {
+                    path.assign(m_cursor->data(), m_cursor->size());
+                    offset = m_list.offset_of(*m_cursor);
+                    ++ m_cursor;
+                }
+                index = m_claimed ++;
+            }
+
+            /* 在锁外面读文件和解码, 解码直接写进allocator的内存; 缓存命中的时候两步都省掉 */
+            cv::Mat frame;
+            if (!m_cache || !m_cache->get(path, frame)){
+                if (m_allocator) frame.allocator = m_allocator;
+                if (readFile(path, bytes)){
+                    /* 先看文件头, 够大的JPEG直接解码成缩小的图片 */
+                    int flag = known ? imgprobe::decode_flag(info, m_reduceTo.width, m_reduceTo.height)
+                                     : imgprobe::decode_flag(bytes.data(), bytes.size(), m_reduceTo.width, m_reduceTo.height);
+                    if (flag != cv::IMREAD_COLOR) m_reduced ++;
+                    cv::imdecode(bytes, flag, &frame);
+                }
+                if (frame.empty())
+                    LOGW("[source] failed to decode %s", path.c_str());
+                else if (m_cache)
+                    m_cache->put(path, frame);
+            }
+
+            {
+                lock_guard<mutex> lock(m_mtx);
+                Slot& slot = m_slots[index % m_slots.size()];
+                slot.frame = move(frame);
+                slot.pos   = Position{index, offset};
+                slot.ready = true;
+            }
+            m_ready.notify_all();
+        }
+        LOGV(BLUE"[decoder%d] finished" CLEAR, decoder);
+    }
+
+    /* 列表已经读完了, 并且认领过的图片都已经被read取走了 */
+    bool finished() const { return m_exhausted && m_next >= m_claimed; }
+
+    static bool readFile(const string& path, vector<uchar>& bytes){
+        FILE* f = fopen(path.c_str(), "rb");
+        if (!f) return false;
+
+        fseek(f, 0, SEEK_END);
+        long size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+
+        bool ok = size > 0;
+        if (ok){
+            bytes.resize(size);
+            ok = fread(bytes.data(), 1, size, f) == (size_t)size;
+        }
+        fclose(f);
+        return ok;
+    }
+
+    int                m_numDecoders;
+    cv::MatAllocator*  m_allocator;
+    imgcache::ImageCache* m_cache;
+    cv::Size           m_reduceTo;    // 为空的时候总是完整解码
+    atomic<long>       m_reduced{0};  // 用缩小的分辨率解码的图片个数
+    vector<Slot>       m_slots;
+    datalist::MappedList           m_list;
+    datalist::MappedList::iterator m_cursor;  // 下一个要被认领的条目
+    manifest::Index    m_index;      // m_manifest时代替m_list, 第m_claimed条就是下一个要被认领的
+    bool               m_manifest{false};
+    Position           m_pos;        // read最近一次返回的帧的位置
+    mutex              m_mtx;
+    condition_variable m_ready;      // 有slot解码好了
+    condition_variable m_free;       // 有slot被read取走了
+    long               m_next{0};    // read下一张要取的图片
+    long               m_claimed{0}; // 已经被解码线程认领的图片个数
+    bool               m_exhausted{false}; // 列表已经读完了
+    bool               m_closed{false};
+    vector<thread>     m_threads;
+};
+
+// 预先解码好的shard, 每一帧都是mmap内存上的Mat
+class ShardSource : public Source{
+public:
+    bool open(const string& path){
+        if (!m_reader.open(path)) return false;
+        LOG("[source] shard with %zu frames", m_reader.size());
+        return true;
+    }
+
+    bool read(cv::Mat& frame) override{
+        if (m_closed || m_next >= m_reader.size()) return false;
+
+        /* 提前几帧告诉内核去读, 第一次跑的时候不至于每一帧都等缺页 */
+        m_reader.prefetch(m_next + kPrefetch);
+        frame = m_reader.frame(m_next ++);
+        return true;
+    }
+
+    void close() override{
+        m_closed = true;
+    }
+
+private:
+    static constexpr size_t kPrefetch = 4;
+
+    shard::Reader      m_reader;
+    size_t             m_next{0};
+    atomic<bool>       m_closed{false};
+};
+
+} // namespace
+
+unique_ptr<Source> create_video_source(const string& path, int numDecoders, int segmentFrames,
+                                       cv::MatAllocator* allocator, int stride){
+    stride = max(stride, 1);
+    if (numDecoders > 1){
+        unique_ptr<SegmentedVideoSource> src(new SegmentedVideoSource(numDecoders, max(segmentFrames, 1), allocator, stride));
+        if (!src->open(path)) return nullptr;
+        return src;
+    }
+
+    unique_ptr<VideoSource> src(new VideoSource(allocator, stride));
+    if (!src->open(path)) return nullptr;
+    return src;
+}
+
+unique_ptr<Source> create_list_source(const string& listFile, int numDecoders, int prefetch,
+                                      cv::MatAllocator* allocator, imgcache::ImageCache* cache, cv::Size reduceTo,
+                                      const Position& resumeAfter){
+    numDecoders = max(numDecoders, 1);
+    unique_ptr<ListSource> src(new ListSource(numDecoders, max(prefetch, numDecoders), allocator, cache, reduceTo));
+    if (!src->open(listFile, resumeAfter)) return nullptr;
+    return src;
+}
+
+unique_ptr<Source> create_shard_source(const string& path){
+    unique_ptr<ShardSource> src(new ShardSource());
+    if (!src->open(path)) return nullptr;
+    return src;
+}
+
+} // namespace source
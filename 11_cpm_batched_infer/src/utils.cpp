@@ -1,3 +1,4 @@
+#include "data_list.hpp"
 #include "utils.hpp"
 #include "logger.hpp"
 
@@ -34,6 +35,7 @@ string changePath(string srcPath, string relativePath, string postfix, string ta
 }
 
 // loadDataList 函数从给定的文件中读取每一行数据，并将其存储到一个字符串向量中。每一行数据代表一个字符串。
+// 文件是mmap进来的, 行的长度没有限制, 行尾的\r和空行会被去掉
 // 假设文件 data.txt 内容如下：
 // line1
 // line2
@@ -42,20 +44,12 @@ string changePath(string srcPath, string relativePath, string postfix, string ta
 // vector<string> list = loadDataList("data.txt");
 // list = {"line1", "line2", "line3"}
 vector<string> loadDataList(string file){
+    datalist::MappedList mapped;
+    if (!mapped.open(file)) LOGE("Failed to open %s", file.c_str());
+
+    /* 需要vector<string>的地方才拷贝, 只是遍历的话直接用datalist::MappedList */
     vector<string> list;
-    auto *f = fopen(file.c_str(), "r");
-    if (!f) LOGE("Failed to open %s", file.c_str());
-
-    char str[512];
-    while (fgets(str, 512, f) != NULL) {
-        for (int i = 0; str[i] != '\0'; ++i) {
-            if (str[i] == '\n'){
-                str[i] = '\0';
-                break;
-            }
-        }
-        list.push_back(str);
-    }
-    fclose(f);
+    for (auto line: mapped)
+        list.emplace_back(line);
     return list;
 }
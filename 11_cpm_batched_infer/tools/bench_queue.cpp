@@ -0,0 +1,75 @@
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "logger.hpp"
+#include "job_queue.hpp"
+
+using namespace std;
+
+/*
+ * job队列的benchmark:
+ *  一个生产者按batch往队列里push_bulk, numWorkers个消费者pop
+ *  消费者对每个job只做很少的工作, 这样测出来的主要就是队列本身的开销
+ *  分别测MutexQueue, RingQueue和StealQueue在1~64个消费者下每秒能传递多少个job
+ */
+
+struct Payload{
+    long id;
+    long pad[7];
+};
+
+static double run(jobqueue::QueueType type, int numWorkers, int batchSize, long total, int work){
+    auto queue = jobqueue::create_queue<Payload>(type, batchSize * 2, numWorkers);
+    atomic<long> consumed{0};
+
+    vector<thread> workers;
+    for (int i = 0; i < numWorkers; i ++){
+        workers.emplace_back([&, i](){
+            Payload job;
+            long    local = 0;
+            while (queue->pop(i, job)){
+                /* 模拟一点点计算量 */
+                volatile long x = job.id;
+                for (int k = 0; k < work; k ++) x = x * 31 + k;
+                local ++;
+            }
+            consumed += local;
+        });
+    }
+
+    auto start = chrono::steady_clock::now();
+    vector<Payload> batch(batchSize);
+    for (long i = 0; i < total; i += batchSize){
+        /* 最后一批不满batchSize的时候只push剩下的 */
+        if (total - i < batchSize) batch.resize(total - i);
+        for (size_t k = 0; k < batch.size(); k ++) batch[k].id = i + k;
+        queue->push_bulk(batch);
+    }
+    queue->close();
+    for (auto& w: workers) w.join();
+    double sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    if (consumed != total)
+        LOGW("lost jobs: %ld/%ld", consumed.load(), total);
+    return consumed / sec;
+}
+
+int main(int argc, char** argv){
+    logger::set_log_level(logger::LogLevel::Info);
+
+    int  batchSize = 32;
+    long total     = argc > 1 ? atol(argv[1]) : 2000000;
+    int  work      = argc > 2 ? atoi(argv[2]) : 50;
+
+    LOG("jobs: %ld, batchSize: %d, work per job: %d", total, batchSize, work);
+    LOG("%-10s %16s %16s %16s", "workers", "mutex(jobs/s)", "ring(jobs/s)", "steal(jobs/s)");
+    for (int numWorkers = 1; numWorkers <= 64; numWorkers *= 2){
+        double mtx   = run(jobqueue::QueueType::Mutex, numWorkers, batchSize, total, work);
+        double ring  = run(jobqueue::QueueType::Ring,  numWorkers, batchSize, total, work);
+        double steal = run(jobqueue::QueueType::Steal, numWorkers, batchSize, total, work);
+        LOG("%-10d %16.0f %16.0f %16.0f", numWorkers, mtx, ring, steal);
+    }
+    return 0;
+}
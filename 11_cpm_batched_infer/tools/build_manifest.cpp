@@ -0,0 +1,42 @@
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include "logger.hpp"
+#include "manifest.hpp"
+
+using namespace std;
+
+/*
+ * 扫描一个图片列表, 只解析每张图片的JPEG/PNG文件头, 生成manifest(格式见include/manifest.hpp):
+ *  ./bin/build_manifest <list.txt> <output.manifest> [threads]
+ *  之后Options::listPath直接指向生成的manifest, 图片列表的source会认出来, mmap之后马上就能用
+ */
+
+int main(int argc, char** argv){
+    logger::set_log_level(logger::LogLevel::Info);
+
+    if (argc < 3){
+        LOG("usage: %s <list.txt> <output.manifest> [threads]", argv[0]);
+        return 1;
+    }
+    string input   = argv[1];
+    string output  = argv[2];
+    int    threads = argc > 3 ? atoi(argv[3]) : 0;
+
+    /* 主要是在等磁盘, 线程可以比核数多 */
+    if (threads <= 0)
+        threads = max((int)thread::hardware_concurrency(), 1) * 4;
+
+    auto start = chrono::steady_clock::now();
+    if (!manifest::build(input, output, threads)){
+        LOGW("Failed to build %s from %s", output.c_str(), input.c_str());
+        return 1;
+    }
+    double sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    manifest::Index index;
+    if (!index.open(output)) return 1;
+    LOG("indexed %zu images into %s in %.2f s with %d threads", index.size(), output.c_str(), sec, threads);
+    return 0;
+}
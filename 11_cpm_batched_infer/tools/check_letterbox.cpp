@@ -0,0 +1,54 @@
+#include <cstdlib>
+#include "logger.hpp"
+#include "letterbox.hpp"
+
+using namespace std;
+
+/*
+ * 对一组固定的输入尺寸跑preprocess::letterbox_check:
+ *  每个尺寸用随机的像素生成一张图, 所有可用的SIMD实现都和letterbox_opencv逐字节比较
+ *  尺寸里包括了放大, 缩小, 不变, 奇数的宽高, 以及宽高都正好缩小一半(cv::resize会换成INTER_AREA)的情况
+ *  ./bin/check_letterbox [target_w] [target_h]
+ *  有任何一个字节不一致时返回1
+ */
+
+struct Case{
+    int width;
+    int height;
+};
+
+int main(int argc, char** argv){
+    logger::set_log_level(logger::LogLevel::Info);
+
+    int target_w = argc > 1 ? atoi(argv[1]) : 800;
+    int target_h = argc > 2 ? atoi(argv[2]) : 800;
+
+    const Case cases[] = {
+        {1600, 1200},   // 正好2倍缩小
+        {1600, 1600},   // 正好2倍缩小, 没有上下的pad
+        {1920, 1080},
+        {1280,  720},
+        { 800,  800},   // 大小不变
+        { 640,  480},   // 放大
+        {1001,  777},   // 奇数的宽高
+        {1601, 1201},   // 接近2倍, 但不是正好
+        {  33,   17},
+    };
+
+    long total = 0;
+    for (auto& c: cases){
+        cv::Mat src(c.height, c.width, CV_8UC3);
+        cv::randu(src, cv::Scalar::all(0), cv::Scalar::all(256));
+
+        long diff = preprocess::letterbox_check(src, target_w, target_h);
+        LOG("%5dx%-5d -> %dx%d: %s", c.width, c.height, target_w, target_h, diff == 0 ? "ok" : "MISMATCH");
+        total += diff;
+    }
+
+    if (total != 0){
+        LOGW("letterbox differs from OpenCV in %ld bytes in total", total);
+        return 1;
+    }
+    LOG("all sizes match OpenCV (best simd: %s)", preprocess::simd_name());
+    return 0;
+}
@@ -0,0 +1,61 @@
+#include <chrono>
+#include <string>
+#include <thread>
+#include "logger.hpp"
+#include "shard.hpp"
+#include "source.hpp"
+
+using namespace std;
+
+/*
+ * 把一个视频或者图片列表解码一次, 打包成shard:
+ *  ./bin/pack_shard <output.shard> <input.mp4 | list.txt> [maxFrames]
+ *  以.txt结尾的输入当成图片列表, 其他的当成视频
+ *  之后forward用Options::sourceType = Shard直接mmap这个文件, 测出来的就只有流水线本身的开销
+ */
+
+static bool endsWith(const string& s, const string& suffix){
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+int main(int argc, char** argv){
+    logger::set_log_level(logger::LogLevel::Info);
+
+    if (argc < 3){
+        LOG("usage: %s <output.shard> <input.mp4 | list.txt> [maxFrames]", argv[0]);
+        return 1;
+    }
+    string output    = argv[1];
+    string input     = argv[2];
+    long   maxFrames = argc > 3 ? atol(argv[3]) : -1;
+
+    /* 解码用和forward一样的source, 多个解码线程并行 */
+    int  decoders = max((int)thread::hardware_concurrency(), 1);
+    auto src      = endsWith(input, ".txt") ? source::create_list_source(input, decoders, decoders * 4)
+                                            : source::create_video_source(input, decoders, 250);
+    if (!src){
+        LOGW("Failed to open %s", input.c_str());
+        return 1;
+    }
+
+    shard::Writer writer;
+    if (!writer.open(output)) return 1;
+
+    auto    start = chrono::steady_clock::now();
+    cv::Mat frame;
+    while ((maxFrames < 0 || (long)writer.count() < maxFrames) && src->read(frame)){
+        if (!writer.add(frame)){
+            LOGW("Failed to write frame %zu to %s", writer.count(), output.c_str());
+            return 1;
+        }
+    }
+    src->close();
+
+    if (!writer.finish()){
+        LOGW("Failed to finish %s", output.c_str());
+        return 1;
+    }
+    double sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    LOG("packed %zu frames into %s in %.2f s", writer.count(), output.c_str(), sec);
+    return 0;
+}